@@ -0,0 +1,109 @@
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include "Archive.h"
+
+GenomeRecord record(const Genome &g)
+{
+    GenomeRecord rec = {};
+
+    rec.n_types = g.n_types;
+    rec.n_synapses = g.n_synapses;
+    rec.th = g.th;
+    rec.fit_cost = g.fit_cost;
+    rec.i2e = g.i2e;
+    rec.total_cost = g.total_cost;
+
+    for (int i = 0; i < g.n_types; i++)
+    {
+        rec.n_cell[i] = g.n_cell[i];
+        rec.axon[i] = g.axon[i];
+        rec.dendrite[i] = g.dendrite[i];
+        rec.phi[i] = g.phi[i];
+        rec.beta[i] = g.beta[i];
+        rec.resistance[i] = g.resistance[i];
+        rec.intvl[i] = g.intvl[i];
+    }
+    return rec;
+}
+
+// The parameters of rec into g, to be organized and built anew
+void restore(Genome &g, const GenomeRecord &rec)
+{
+    g.n_types = rec.n_types;
+    g.th = rec.th;
+
+    for (int i = 0; i < MAX_TYPES; i++)
+    {
+        g.n_cell[i] = rec.n_cell[i];
+        g.axon[i] = rec.axon[i];
+        g.dendrite[i] = rec.dendrite[i];
+        g.phi[i] = rec.phi[i];
+        g.beta[i] = rec.beta[i];
+        g.resistance[i] = rec.resistance[i];
+        g.intvl[i] = rec.intvl[i];
+    }
+    g.dirty = ALL_LAYERS;
+}
+
+Archive::Archive() : contributions(0) {}
+
+int Archive::add(const Genome *g, const int n, const int tid)
+{
+    std::vector<Entry> local(n);
+
+    // Serialize outside the lock
+    for (int i = 0; i < n; i++)
+    {
+        GenomeRecord rec = record(g[i]);
+        local[i].tid = tid;
+        local[i].rank = i;
+        local[i].genome.assign((const char *) &rec,
+                               (const char *) &rec + sizeof(rec));
+        g[i].r->serialize(local[i].blob);
+    }
+
+    std::lock_guard<std::mutex> lock(m);
+    for (int i = 0; i < n; i++) entries.push_back(std::move(local[i]));
+    return ++contributions; // Including this one
+}
+
+void Archive::save(const std::string &fname)
+{
+    std::lock_guard<std::mutex> lock(m);
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b)
+              { return (a.tid != b.tid)? a.tid < b.tid : a.rank < b.rank; });
+
+    uint32_t n = entries.size();
+    uint64_t offset = 4 + 3 * sizeof(uint32_t) + n * sizeof(IndexEntry);
+    uint64_t total = offset;
+    for (const Entry &e : entries) total += e.genome.size() + e.blob.size();
+
+    // Assemble the whole file, then write it at once
+    std::vector<char> out(total);
+    char *p = out.data();
+
+    uint32_t hdr[3] = {ARCHIVE_VERSION, n, MAX_TYPES};
+    std::memcpy(p, "RARC", 4);
+    std::memcpy(p + 4, hdr, sizeof(hdr));
+    p += 4 + sizeof(hdr);
+
+    char *data = out.data() + offset;
+    for (const Entry &e : entries)
+    {
+        IndexEntry idx = {e.tid, e.rank, offset, e.blob.size()};
+        std::memcpy(p, &idx, sizeof(idx));
+        p += sizeof(idx);
+
+        std::memcpy(data, e.genome.data(), e.genome.size());
+        std::memcpy(data + e.genome.size(), e.blob.data(), e.blob.size());
+        data += e.genome.size() + e.blob.size();
+        offset += e.genome.size() + e.blob.size();
+    }
+
+    std::ofstream f(fname, std::ios::binary);
+    f.write(out.data(), out.size());
+    f.close();
+}
@@ -0,0 +1,68 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include "Retina.h"
+
+#define ARCHIVE_VERSION 1
+
+/*
+ * Single-file store for the final elites of every thread of a run,
+ * written in one sequential write once all threads have contributed.
+ *
+ * Layout (native endianness):
+ *   header: "RARC" | u32 version | u32 n_records | u32 max_types
+ *   index:  n_records x IndexEntry
+ *   data:   per record, a GenomeRecord followed by its connectivity blob
+ * Blob: u32 n_edges, then per edge i32 from | i32 to | i32 rows | i32 cols
+ * and rows * cols f64 weights, column-major. See retina_io.read_archive.
+ */
+struct IndexEntry
+{
+    int32_t tid;
+    int32_t rank;
+    uint64_t offset; // Of the GenomeRecord, from the start of the file
+    uint64_t blob_bytes;
+};
+
+struct GenomeRecord
+{
+    int32_t n_types;
+    int32_t n_synapses;
+    int32_t n_cell[MAX_TYPES];
+    int32_t pad;
+    double th, fit_cost, i2e, total_cost;
+    double axon[MAX_TYPES];
+    double dendrite[MAX_TYPES];
+    double phi[MAX_TYPES];
+    double beta[MAX_TYPES];
+    double resistance[MAX_TYPES];
+    double intvl[MAX_TYPES];
+};
+
+GenomeRecord record(const Genome &g);
+void restore(Genome &g, const GenomeRecord &rec);
+
+class Archive
+{
+public:
+    Archive();
+    int add(const Genome *g, const int n, const int tid);
+    void save(const std::string &fname);
+
+private:
+    struct Entry
+    {
+        int tid, rank;
+        std::vector<char> genome, blob;
+    };
+
+    std::vector<Entry> entries;
+    int contributions;
+    std::mutex m;
+};
+
+#endif
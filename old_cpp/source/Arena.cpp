@@ -0,0 +1,127 @@
+#include <cstdlib>
+#include <algorithm>
+#include "Arena.h"
+
+#define ARENA_ALIGN 64
+#define ARENA_CHUNK (1 << 20)
+
+thread_local Arena ARENA;
+
+static char *chunk_alloc(const size_t size)
+{
+    return (char *) std::aligned_alloc(ARENA_ALIGN, size);
+}
+
+Arena::Arena() : cur(0), top(0), used_before(0), high(0) {}
+
+Arena::~Arena()
+{
+    for (Chunk &c : chunks) std::free(c.data);
+}
+
+double *Arena::alloc(const size_t n)
+{
+    size_t bytes = (n * sizeof(double) + ARENA_ALIGN - 1) / ARENA_ALIGN
+                   * ARENA_ALIGN;
+    if (bytes == 0) return nullptr;
+
+    if (chunks.empty() || top + bytes > chunks[cur].size)
+    {
+        if (!chunks.empty())
+        {
+            used_before += chunks[cur].size;
+            cur++;
+        }
+
+        // Drop chunks too small to be of use, then chain a new one
+        if (cur < chunks.size() && chunks[cur].size < bytes)
+        {
+            for (size_t k = cur; k < chunks.size(); k++)
+                std::free(chunks[k].data);
+            chunks.resize(cur);
+        }
+        if (cur == chunks.size())
+        {
+            size_t size = std::max({bytes, (size_t) ARENA_CHUNK,
+                                    2 * used_before});
+            chunks.push_back({chunk_alloc(size), size});
+        }
+        top = 0;
+    }
+
+    double *p = (double *) (chunks[cur].data + top);
+    top += bytes;
+    high = std::max(high, used_before + top);
+    return p;
+}
+
+Eigen::Map<Eigen::MatrixXd> Arena::matrix(const long rows, const long cols)
+{
+    return Eigen::Map<Eigen::MatrixXd>(alloc(rows * cols), rows, cols);
+}
+
+Arena::Mark Arena::mark() const
+{
+    return {cur, top};
+}
+
+void Arena::release(const Mark &m)
+{
+    for (size_t k = m.chunk; k < cur; k++) used_before -= chunks[k].size;
+    cur = m.chunk;
+    top = m.top;
+}
+
+// O(1) unless the last generation overflowed into more chunks
+void Arena::reset()
+{
+    if (chunks.size() > 1)
+    {
+        size_t total = 0;
+        for (Chunk &c : chunks)
+        {
+            total += c.size;
+            std::free(c.data);
+        }
+        chunks.assign(1, {chunk_alloc(total), total});
+    }
+    cur = 0;
+    top = 0;
+    used_before = 0;
+}
+
+/*
+ * Called by every thread of an OpenMP region after its loop, with the
+ * arena of the thread that started it. A worker's arena is reset, as the
+ * owner's is at the generation boundary, and its peak recorded in the
+ * owner's.
+ */
+void Arena::settle(Arena &owner)
+{
+    if (this == &owner) return;
+    reset();
+
+    #pragma omp critical (arena_settle)
+    {
+        auto w = std::find_if(owner.team.begin(), owner.team.end(),
+            [this](const std::pair<const Arena *, size_t> &t)
+            { return t.first == this; });
+        if (w == owner.team.end()) owner.team.push_back({this, high});
+        else w->second = high;
+    }
+}
+
+// Of this arena and the workers' that settled into it
+size_t Arena::peak() const
+{
+    size_t total = high;
+    for (const auto &w : team) total += w.second;
+    return total;
+}
+
+ArenaScope::ArenaScope(Arena &a_) : a(a_), m(a_.mark()) {}
+
+ArenaScope::~ArenaScope()
+{
+    a.release(m);
+}
@@ -0,0 +1,66 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+
+/*
+ * Bump allocator for the scratch memory of react and nn, released when
+ * the ArenaScope that allocated it ends. If a generation outgrows the
+ * arena, it chains another chunk, and the next reset() at the generation
+ * boundary merges the chunks so that steady state is a single block and
+ * no malloc at all. OpenMP workers have arenas of their own, which
+ * settle() resets at the end of each region they work in.
+ */
+class Arena
+{
+public:
+    struct Mark
+    {
+        size_t chunk, top;
+    };
+
+    Arena();
+    ~Arena();
+    double *alloc(const size_t n);
+    Eigen::Map<Eigen::MatrixXd> matrix(const long rows, const long cols);
+    Mark mark() const;
+    void release(const Mark &m);
+    void reset();
+    void settle(Arena &owner);
+    size_t peak() const;
+
+private:
+    struct Chunk
+    {
+        char *data;
+        size_t size;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t cur, top, used_before; // used_before: bytes in chunks before cur
+    size_t high;
+    std::vector<std::pair<const Arena *, size_t>> team; // Workers' peaks
+
+    Arena(const Arena &);
+    Arena &operator=(const Arena &);
+};
+
+// Releases everything allocated from the arena during its lifetime
+class ArenaScope
+{
+public:
+    ArenaScope(Arena &a);
+    ~ArenaScope();
+
+private:
+    Arena &a;
+    Arena::Mark m;
+};
+
+extern thread_local Arena ARENA;
+
+#endif
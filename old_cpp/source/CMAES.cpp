@@ -0,0 +1,79 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "CMAES.h"
+#include "tool.h"
+
+CMAES::CMAES(const VectorXd &mean, const double sigma_, const int lambda_)
+{
+    d = mean.size();
+    lambda = (lambda_ > 0)? lambda_ : 4 + (int) (3 * std::log(d));
+    mu = lambda / 2;
+    gen = 0;
+    sigma = sigma_;
+    m = mean;
+
+    w.resize(mu);
+    for (int i = 0; i < mu; i++) w(i) = std::log(mu + 0.5) - std::log(i + 1.0);
+    w /= w.sum();
+    mueff = 1 / w.squaredNorm();
+
+    cc = (4 + mueff / d) / (d + 4 + 2 * mueff / d);
+    cs = (mueff + 2) / (d + mueff + 5);
+    c1 = 2 / ((d + 1.3) * (d + 1.3) + mueff);
+    cmu = std::min(1 - c1, 2 * (mueff - 2 + 1 / mueff)
+                           / ((d + 2) * (d + 2) + mueff));
+    damps = 1 + 2 * std::max(0.0, std::sqrt((mueff - 1) / (d + 1)) - 1) + cs;
+    chi_n = std::sqrt(d) * (1 - 1.0 / (4 * d) + 1.0 / (21.0 * d * d));
+
+    pc = VectorXd::Zero(d);
+    ps = VectorXd::Zero(d);
+    C = MatrixXd::Identity(d, d);
+    B = MatrixXd::Identity(d, d);
+    D = VectorXd::Ones(d);
+}
+
+// x = m + sigma * B * D * z, z standard normal
+void CMAES::sample(MatrixXd &X)
+{
+    X.resize(d, lambda);
+    VectorXd z(d);
+    for (int k = 0; k < lambda; k++)
+    {
+        for (int i = 0; i < d; i++) z(i) = normal(0, 1);
+        X.col(k) = m + sigma * (B * D.cwiseProduct(z));
+    }
+}
+
+void CMAES::tell(const MatrixXd &X, const VectorXd &cost)
+{
+    std::vector<int> order(lambda);
+    for (int k = 0; k < lambda; k++) order[k] = k;
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b) { return cost(a) < cost(b); });
+
+    // Steps of the mu best, in units of sigma
+    MatrixXd Y(d, mu);
+    for (int i = 0; i < mu; i++) Y.col(i) = (X.col(order[i]) - m) / sigma;
+    VectorXd yw = Y * w;
+    m += sigma * yw;
+    gen++;
+
+    // Evolution paths; C^-1/2 yw = B D^-1 B' yw
+    VectorXd c_yw = B * (B.transpose() * yw).cwiseQuotient(D);
+    ps = (1 - cs) * ps + std::sqrt(cs * (2 - cs) * mueff) * c_yw;
+    double hsig = ps.norm() / std::sqrt(1 - std::pow(1 - cs, 2 * gen))
+                  / chi_n < 1.4 + 2.0 / (d + 1);
+    pc = (1 - cc) * pc + hsig * std::sqrt(cc * (2 - cc) * mueff) * yw;
+
+    // Rank-one and rank-mu updates
+    C = (1 - c1 - cmu) * C
+        + c1 * (pc * pc.transpose() + (1 - hsig) * cc * (2 - cc) * C)
+        + cmu * Y * w.asDiagonal() * Y.transpose();
+    sigma *= std::exp(cs / damps * (ps.norm() / chi_n - 1));
+
+    C = (C + C.transpose()) / 2;
+    Eigen::SelfAdjointEigenSolver<MatrixXd> eig(C);
+    B = eig.eigenvectors();
+    D = eig.eigenvalues().cwiseMax(1e-20).cwiseSqrt();
+}
@@ -0,0 +1,31 @@
+#ifndef CMAES_H
+#define CMAES_H
+
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+/*
+ * (mu/mu_w, lambda)-CMA-ES with the default strategy parameters of
+ * Hansen's tutorial, minimizing. sample() draws a batch of lambda
+ * candidates as the columns of X; tell() takes their costs and adapts
+ * the mean, step size and covariance.
+ */
+class CMAES
+{
+public:
+    CMAES(const VectorXd &mean, const double sigma, const int lambda);
+    void sample(MatrixXd &X);
+    void tell(const MatrixXd &X, const VectorXd &cost);
+
+    int lambda;
+
+private:
+    int d, mu, gen;
+    double sigma, mueff, cc, cs, c1, cmu, damps, chi_n;
+    VectorXd m, w, pc, ps, D; // D: sqrt of the eigenvalues of C
+    MatrixXd C, B; // B: eigenvectors of C
+};
+
+#endif
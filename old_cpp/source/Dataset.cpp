@@ -0,0 +1,220 @@
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Dataset.h"
+#include "tool.h"
+
+typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    RowMatrixXd;
+typedef Eigen::Map<const RowMatrixXd, 0, Eigen::OuterStride<>> RowsMap;
+
+static_assert(sizeof(DatasetHeader) == 64, "Dataset header is one cache line");
+
+// False if fname does not exist or is not a dataset
+bool load_dataset(const std::string &fname, Dataset &d)
+{
+    std::ifstream f(fname, std::ios::binary);
+    DatasetHeader h;
+    if (!f.read((char *) &h, sizeof(h))) return false;
+    if (std::memcmp(h.magic, "RDAT", 4) != 0 || h.version != DATASET_VERSION)
+        return false;
+
+    d.sigs.resize(h.rows, h.cells);
+    d.st.resize(h.rows, h.targets);
+
+    std::vector<double> row(h.cells + h.targets);
+    for (uint64_t i = 0; i < h.rows; i++)
+    {
+        if (!f.read((char *) row.data(), row.size() * sizeof(double)))
+            return false;
+        for (uint32_t j = 0; j < h.cells; j++) d.sigs(i, j) = row[j];
+        for (uint32_t j = 0; j < h.targets; j++)
+            d.st(i, j) = row[h.cells + j];
+    }
+    return true;
+}
+
+static DatasetHeader header(const long rows, const int cells,
+                            const int targets)
+{
+    DatasetHeader h = {};
+    std::memcpy(h.magic, "RDAT", 4);
+    h.version = DATASET_VERSION;
+    h.rows = rows;
+    h.cells = cells;
+    h.targets = targets;
+    return h;
+}
+
+static void write_rows(std::ofstream &f, const Dataset &d)
+{
+    std::vector<double> row(d.sigs.cols() + d.st.cols());
+    for (long i = 0; i < d.sigs.rows(); i++)
+    {
+        for (long j = 0; j < d.sigs.cols(); j++) row[j] = d.sigs(i, j);
+        for (long j = 0; j < d.st.cols(); j++)
+            row[d.sigs.cols() + j] = d.st(i, j);
+        f.write((const char *) row.data(), row.size() * sizeof(double));
+    }
+}
+
+// Files are written under a temporary name and renamed over fname only
+// once complete, so that an interrupted or failed write never leaves a
+// partial dataset behind
+static std::string temp_name(const std::string &fname)
+{
+    return fname + ".tmp" + std::to_string(getpid());
+}
+
+static bool finish(std::ofstream &f, const std::string &tmp,
+                   const std::string &fname)
+{
+    f.close();
+    if (f && std::rename(tmp.c_str(), fname.c_str()) == 0) return true;
+    std::remove(tmp.c_str());
+    return false;
+}
+
+// False if fname could not be written
+bool save_dataset(const std::string &fname, const Dataset &d)
+{
+    DatasetHeader h = header(d.sigs.rows(), d.sigs.cols(), d.st.cols());
+    std::string tmp = temp_name(fname);
+    std::ofstream f(tmp, std::ios::binary);
+    f.write((const char *) &h, sizeof(h));
+    write_rows(f, d);
+    return finish(f, tmp, fname);
+}
+
+// generate_data() `chunk` rows at a time straight to the file, for datasets
+// larger than memory. Rows are independent, so this is the same
+// distribution as one call. False if fname could not be written.
+bool generate_dataset(const std::string &fname, const long rows,
+                      const int chunk)
+{
+    std::string tmp = temp_name(fname);
+    std::ofstream f(tmp, std::ios::binary);
+    Dataset d;
+
+    for (long r0 = 0; r0 < rows; r0 += chunk)
+    {
+        generate_data(d.sigs, d.st, std::min((long) chunk, rows - r0));
+        if (r0 == 0)
+        {
+            DatasetHeader h = header(rows, d.sigs.cols(), d.st.cols());
+            f.write((const char *) &h, sizeof(h));
+        }
+        write_rows(f, d);
+        if (!f) break;
+    }
+    return finish(f, tmp, fname);
+}
+
+DataFile::DataFile(const std::string &fname)
+    : h(), map(nullptr), bytes(0), data(nullptr)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (::read(fd, &h, sizeof(h)) == sizeof(h)
+        && std::memcmp(h.magic, "RDAT", 4) == 0
+        && h.version == DATASET_VERSION && fstat(fd, &st) == 0)
+    {
+        bytes = sizeof(h) + h.rows * (h.cells + h.targets) * sizeof(double);
+        // Cut short, as by an interrupted copy: not open, so that it is
+        // generated again instead of faulting past its end
+        if (st.st_size < (off_t) bytes)
+        {
+            bytes = 0;
+            close(fd);
+            return;
+        }
+        map = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) map = nullptr;
+        else
+        {
+            madvise(map, bytes, MADV_SEQUENTIAL);
+            data = (const double *) ((const char *) map + sizeof(h));
+        }
+    }
+    close(fd);
+}
+
+DataFile::~DataFile()
+{
+    if (map) munmap(map, bytes);
+}
+
+// Rows [r0, r0 + n)
+void DataFile::read(const long r0, const int n, MatrixXd &sigs,
+                    MatrixXd &st) const
+{
+    const long stride = h.cells + h.targets;
+    const double *p = data + r0 * stride;
+    sigs = RowsMap(p, n, h.cells, Eigen::OuterStride<>(stride));
+    st = RowsMap(p + h.cells, n, h.targets, Eigen::OuterStride<>(stride));
+}
+
+// Targets of rows [r0, r0 + n)
+void DataFile::read(const long r0, const int n, MatrixXd &st) const
+{
+    const long stride = h.cells + h.targets;
+    st = RowsMap(data + r0 * stride + h.cells, n, h.targets,
+                 Eigen::OuterStride<>(stride));
+}
+
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+    RowMatrixXf;
+
+SpillFile::SpillFile(const std::string &dir, const long rows, const int cols_)
+    : cols(cols_), map(nullptr), bytes(rows * cols_ * sizeof(float)),
+      data(nullptr)
+{
+    std::string tmpl = dir + "/spill.XXXXXX";
+    int fd = mkstemp(&tmpl[0]);
+    if (fd >= 0)
+    {
+        unlink(tmpl.c_str()); // Freed with the mapping, however we exit
+        if (bytes > 0 && ftruncate(fd, bytes) == 0)
+        {
+            map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+            if (map == MAP_FAILED) map = nullptr;
+        }
+        close(fd);
+    }
+
+    if (map) data = (float *) map;
+    else
+    {
+        mem.resize(rows * cols);
+        data = mem.data();
+    }
+}
+
+SpillFile::~SpillFile()
+{
+    if (map) munmap(map, bytes);
+}
+
+// x into rows [r0, r0 + x.rows())
+void SpillFile::write(const long r0, const MatrixXd &x)
+{
+    Eigen::Map<RowMatrixXf>(data + r0 * cols, x.rows(), cols) =
+        x.cast<float>();
+}
+
+// Rows [r0, r0 + n)
+void SpillFile::read(const long r0, const int n, MatrixXd &x) const
+{
+    x = Eigen::Map<const RowMatrixXf>(data + r0 * cols, n, cols)
+        .cast<double>();
+}
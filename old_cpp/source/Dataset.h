@@ -0,0 +1,94 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+using Eigen::MatrixXd;
+
+#define DATASET_VERSION 1
+
+/*
+ * Stimuli and targets of a run, generated once and read by any number of
+ * GA threads. A dataset file holds the same, so that runs can share it.
+ *
+ * Layout (native endianness):
+ *   header: DatasetHeader, padded to 64 bytes
+ *   data:   per row, `cells` f64 signals then `targets` f64 targets
+ * Rows are contiguous and the data starts on a cache line, so that the
+ * file can be mapped and read a block of rows at a time.
+ */
+struct DatasetHeader
+{
+    char magic[4]; // "RDAT"
+    uint32_t version;
+    uint64_t rows;
+    uint32_t cells;
+    uint32_t targets;
+    char pad[40];
+};
+
+struct Dataset
+{
+    MatrixXd sigs, st;
+};
+
+bool load_dataset(const std::string &fname, Dataset &d);
+bool save_dataset(const std::string &fname, const Dataset &d);
+bool generate_dataset(const std::string &fname, const long rows,
+                      const int chunk);
+
+// A dataset file mapped read-only, for reading a block of rows at a time
+// without loading the rest
+class DataFile
+{
+public:
+    explicit DataFile(const std::string &fname);
+    ~DataFile();
+
+    bool is_open() const { return data != nullptr; }
+    long rows() const { return h.rows; }
+    int cells() const { return h.cells; }
+    int targets() const { return h.targets; }
+    void read(const long r0, const int n, MatrixXd &sigs, MatrixXd &st) const;
+    void read(const long r0, const int n, MatrixXd &st) const;
+
+private:
+    DatasetHeader h;
+    void *map;
+    size_t bytes;
+    const double *data; // First row
+
+    DataFile(const DataFile &) = delete;
+    DataFile &operator=(const DataFile &) = delete;
+};
+
+/*
+ * Rows of f32 in an unlinked temporary file in dir, mapped read-write, so
+ * that rows written once are read back any number of times while the
+ * kernel keeps only the pages in use. Held in memory instead if the file
+ * cannot be made.
+ */
+class SpillFile
+{
+public:
+    SpillFile(const std::string &dir, const long rows, const int cols);
+    ~SpillFile();
+
+    void write(const long r0, const MatrixXd &x);
+    void read(const long r0, const int n, MatrixXd &x) const;
+
+private:
+    int cols;
+    void *map;
+    size_t bytes;
+    std::vector<float> mem; // If not mapped
+    float *data;
+
+    SpillFile(const SpillFile &) = delete;
+    SpillFile &operator=(const SpillFile &) = delete;
+};
+
+#endif
@@ -0,0 +1,354 @@
+#include <sstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <tuple>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "FitnessDB.h"
+#include "tool.h"
+
+#define LOG_HEADER 16
+
+FitnessDB FITNESS_DB;
+
+// FNV-1a over 8-byte words, then a splitmix finalizer
+uint64_t hash_bytes(const void *p, const size_t n, uint64_t h)
+{
+    const unsigned char *c = (const unsigned char *) p;
+    h ^= 14695981039346656037ULL;
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, c + i, 8);
+        h = (h ^ w) * 1099511628211ULL;
+    }
+    for (; i < n; i++) h = (h ^ c[i]) * 1099511628211ULL;
+
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+// Of its parameters alone, as organize() left them, in a canonical form.
+// Interneuron layers all take the receptors and feed the ganglion cells,
+// so their order does not matter and they are sorted; intvl follows from
+// n_cell and is left out
+uint64_t genome_hash(const Genome &g)
+{
+    GenomeRecord rec = record(g);
+    rec.n_synapses = 0;
+    rec.fit_cost = rec.i2e = rec.total_cost = 0;
+    std::fill(rec.intvl, rec.intvl + MAX_TYPES, 0.0);
+
+    typedef std::tuple<int32_t, double, double, double, double, double> Layer;
+    std::vector<Layer> inter;
+    for (int i = 1; i < rec.n_types - 1; i++)
+        inter.emplace_back(rec.n_cell[i], rec.axon[i], rec.dendrite[i],
+                           rec.phi[i], rec.beta[i], rec.resistance[i]);
+    std::sort(inter.begin(), inter.end());
+
+    for (size_t k = 0; k < inter.size(); k++)
+    {
+        int i = k + 1;
+        std::tie(rec.n_cell[i], rec.axon[i], rec.dendrite[i], rec.phi[i],
+                 rec.beta[i], rec.resistance[i]) = inter[k];
+    }
+    return hash_bytes(&rec, sizeof(rec));
+}
+
+uint64_t data_hash(const MatrixXd &x, const MatrixXd &y)
+{
+    int64_t dims[4] = {x.rows(), x.cols(), y.rows(), y.cols()};
+    uint64_t h = hash_bytes(dims, sizeof(dims));
+    h = hash_bytes(x.data(), sizeof(double) * x.size(), h);
+    return hash_bytes(y.data(), sizeof(double) * y.size(), h);
+}
+
+// The settings besides genome and data that fit_cost depends on
+uint64_t config_hash()
+{
+    std::ostringstream s;
+    s.precision(17);
+    s << T << " " << TAU << " " << ETA << " " << EPOCHS << " " << TRAIN_SIZE
+      << " " << TEST_SIZE << " " << DICISION_BOUNDARY << " " << REACT_TOL
+      << " " << REACT_K << " " << MOSAIC << " " << W_TASKS.transpose();
+    std::string str = s.str();
+    return hash_bytes(str.data(), str.size());
+}
+
+FitnessDB::FitnessDB()
+    : log_fd(-1), idx_fd(-1), ih(nullptr), slots(nullptr), mapped(0) {}
+
+FitnessDB::~FitnessDB()
+{
+    close();
+}
+
+bool FitnessDB::open(const std::string &path)
+{
+    close();
+
+    log_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    idx_fd = ::open((path + ".idx").c_str(), O_RDWR | O_CREAT, 0644);
+    if (log_fd < 0 || idx_fd < 0)
+    {
+        close();
+        return false;
+    }
+
+    lock();
+    bool ok = true;
+    char h[LOG_HEADER] = {'R', 'F', 'D', 'B'};
+    uint32_t fields[3] = {FITNESS_DB_VERSION, sizeof(FitRecord), MAX_TYPES};
+    struct stat st;
+    fstat(log_fd, &st);
+    if (st.st_size == 0)
+    {
+        memcpy(h + 4, fields, sizeof(fields));
+        ok = pwrite(log_fd, h, LOG_HEADER, 0) == LOG_HEADER;
+    }
+    else ok = pread(log_fd, h, LOG_HEADER, 0) == LOG_HEADER &&
+              memcmp(h, "RFDB", 4) == 0 &&
+              memcmp(h + 4, fields, sizeof(fields)) == 0;
+
+    // A new or foreign index is rebuilt from the log
+    IndexHeader ix;
+    if (ok && (pread(idx_fd, &ix, sizeof(ix), 0) != sizeof(ix) ||
+               memcmp(ix.magic, "RFDX", 4) != 0 ||
+               ix.version != FITNESS_DB_VERSION || !map(ix.capacity)))
+        rebuild(1024);
+    if (ok) sync();
+    unlock();
+
+    if (!ok) close();
+    return ok;
+}
+
+void FitnessDB::close()
+{
+    if (ih) munmap(ih, sizeof(IndexHeader) + mapped * sizeof(IndexSlot));
+    if (log_fd >= 0) ::close(log_fd);
+    if (idx_fd >= 0) ::close(idx_fd);
+    log_fd = idx_fd = -1;
+    ih = nullptr;
+    slots = nullptr;
+    mapped = 0;
+}
+
+// Threads of this process by the mutex, other processes by the flock
+void FitnessDB::lock()
+{
+    m.lock();
+    flock(idx_fd, LOCK_EX);
+}
+
+void FitnessDB::unlock()
+{
+    flock(idx_fd, LOCK_UN);
+    m.unlock();
+}
+
+// Whole records in the log; a torn last one is overwritten by add()
+long FitnessDB::records()
+{
+    struct stat st;
+    fstat(log_fd, &st);
+    return std::max(0L, (long) (st.st_size - LOG_HEADER)) / sizeof(FitRecord);
+}
+
+long FitnessDB::size()
+{
+    std::lock_guard<std::mutex> guard(m);
+    return is_open()? records() : 0;
+}
+
+bool FitnessDB::map(const uint64_t capacity)
+{
+    if (ih) munmap(ih, sizeof(IndexHeader) + mapped * sizeof(IndexSlot));
+    ih = nullptr;
+    slots = nullptr;
+    mapped = 0;
+
+    size_t bytes = sizeof(IndexHeader) + capacity * sizeof(IndexSlot);
+    struct stat st;
+    fstat(idx_fd, &st);
+    if (capacity == 0 || (size_t) st.st_size < bytes) return false;
+
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   idx_fd, 0);
+    if (p == MAP_FAILED) return false;
+
+    ih = (IndexHeader *) p;
+    slots = (IndexSlot *) (ih + 1);
+    mapped = capacity;
+    return true;
+}
+
+static uint64_t slot_key(const uint64_t genome, const uint64_t data,
+                         const uint64_t config)
+{
+    uint64_t k[3] = {genome, data, config};
+    uint64_t h = hash_bytes(k, sizeof(k));
+    return h? h : 1;
+}
+
+void FitnessDB::insert(const uint64_t key, const uint64_t record)
+{
+    uint64_t mask = mapped - 1;
+    for (uint64_t s = key & mask; ; s = (s + 1) & mask)
+    {
+        if (slots[s].key == 0)
+        {
+            slots[s].key = key;
+            slots[s].record = record;
+            return;
+        }
+        if (slots[s].key == key) return; // The first record of a key stays
+    }
+}
+
+// Under the lock: a fresh index of the whole log at the given capacity
+void FitnessDB::rebuild(uint64_t capacity)
+{
+    long n = records();
+    while ((uint64_t) (n + 1) * 2 > capacity) capacity *= 2;
+
+    if (ftruncate(idx_fd, 0) != 0 ||
+        ftruncate(idx_fd, sizeof(IndexHeader) + capacity * sizeof(IndexSlot))
+        != 0 || !map(capacity))
+        return;
+
+    memcpy(ih->magic, "RFDX", 4);
+    ih->version = FITNESS_DB_VERSION;
+    ih->capacity = capacity;
+    ih->count = 0;
+    sync();
+}
+
+// Under the lock: follow another process's rebuild, and index the records
+// appended since the index last saw the log
+void FitnessDB::sync()
+{
+    if (!ih) return;
+    if (ih->capacity != mapped && !map(ih->capacity))
+    {
+        rebuild(1024);
+        return;
+    }
+
+    long n = records();
+    if ((uint64_t) n <= ih->count) return;
+    if ((uint64_t) (n + 1) * 2 > mapped)
+    {
+        rebuild(mapped * 2);
+        return;
+    }
+
+    const int chunk = 4096;
+    std::vector<FitRecord> buf(chunk);
+    for (long r0 = ih->count; r0 < n; r0 += chunk)
+    {
+        int nc = std::min((long) chunk, n - r0);
+        ssize_t bytes = nc * sizeof(FitRecord);
+        if (pread(log_fd, buf.data(), bytes,
+                  LOG_HEADER + r0 * sizeof(FitRecord)) != bytes)
+            return;
+
+        for (int i = 0; i < nc; i++)
+            insert(slot_key(buf[i].genome, buf[i].data, buf[i].config),
+                   r0 + i);
+        ih->count = r0 + nc;
+    }
+}
+
+bool FitnessDB::find(const uint64_t genome, const uint64_t data,
+                     const uint64_t config, FitRecord &rec)
+{
+    if (!is_open()) return false;
+
+    lock();
+    sync();
+    bool found = false;
+    uint64_t key = slot_key(genome, data, config), mask = mapped - 1;
+    for (uint64_t s = key & mask; ih && slots[s].key != 0; s = (s + 1) & mask)
+    {
+        if (slots[s].key != key) continue;
+
+        found = pread(log_fd, &rec, sizeof(rec),
+                      LOG_HEADER + slots[s].record * sizeof(FitRecord))
+                == sizeof(rec) && rec.genome == genome && rec.data == data &&
+                rec.config == config;
+        break;
+    }
+    unlock();
+    return found;
+}
+
+void FitnessDB::add(const std::vector<FitRecord> &recs)
+{
+    if (!is_open() || recs.empty()) return;
+
+    lock();
+    sync();
+    long n = records();
+    ssize_t bytes = recs.size() * sizeof(FitRecord);
+    if (pwrite(log_fd, recs.data(), bytes, LOG_HEADER + n * sizeof(FitRecord))
+        == bytes)
+        sync();
+    unlock();
+}
+
+/*
+ * The n stored genomes of the lowest fit_cost under config, on any
+ * dataset, each genome once by its best record. One sequential pass over
+ * the log.
+ */
+std::vector<FitRecord> FitnessDB::best(const uint64_t config, const int n)
+{
+    std::vector<FitRecord> out;
+    if (!is_open() || n <= 0) return out;
+
+    // The best record of each genome; a genome's later records may beat
+    // its first
+    std::unordered_map<uint64_t, FitRecord> best;
+
+    lock();
+    long total = records();
+    const int chunk = 4096;
+    std::vector<FitRecord> buf(chunk);
+    for (long r0 = 0; r0 < total; r0 += chunk)
+    {
+        int nc = std::min((long) chunk, total - r0);
+        ssize_t bytes = nc * sizeof(FitRecord);
+        if (pread(log_fd, buf.data(), bytes,
+                  LOG_HEADER + r0 * sizeof(FitRecord)) != bytes)
+            break;
+
+        for (int i = 0; i < nc; i++)
+        {
+            const FitRecord &rec = buf[i];
+            if (rec.config != config || std::isnan(rec.fit_cost)) continue;
+
+            auto it = best.emplace(rec.genome, rec);
+            if (!it.second && rec.fit_cost < it.first->second.fit_cost)
+                it.first->second = rec;
+        }
+    }
+    unlock();
+
+    out.reserve(best.size());
+    for (const auto &kv : best) out.push_back(kv.second);
+    size_t m = std::min((size_t) n, out.size());
+    std::partial_sort(out.begin(), out.begin() + m, out.end(),
+                      [](const FitRecord &a, const FitRecord &b)
+                      { return a.fit_cost < b.fit_cost; });
+    out.resize(m);
+    return out;
+}
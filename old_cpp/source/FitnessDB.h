@@ -0,0 +1,93 @@
+#ifndef FITNESS_DB_H
+#define FITNESS_DB_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+#include "Retina.h"
+#include "Archive.h"
+using Eigen::MatrixXd;
+
+#define FITNESS_DB_VERSION 2
+
+/*
+ * Append-only store of every evaluation, shared by the threads of a run,
+ * the configs of a sweep and later runs. Keyed by the hashes of the
+ * organized genome in canonical form, of the dataset and of the settings
+ * fit_cost depends on, so a repeated key is a repeated evaluation.
+ *
+ * Files (native endianness):
+ *   <path>:      "RFDB" | u32 version | u32 record bytes | u32 max_types,
+ *                then FitRecords in the order they were added
+ *   <path>.idx:  "RFDX" | u32 version | u64 capacity | u64 records indexed
+ *                | padding to 64 bytes, then capacity x IndexSlot,
+ *                open addressing with linear probing
+ * The log is the truth; the index is mapped, caught up with records other
+ * processes appended and rebuilt from the log when it fills or is lost.
+ * Writers hold an flock on the index. retina_io.read_fitness_db reads
+ * the log.
+ */
+struct FitRecord
+{
+    uint64_t genome, data, config; // The key
+    double fit_cost;
+    int32_t n_synapses;
+    float seconds; // Of the evaluation, averaged over its batch
+    GenomeRecord g;
+};
+
+struct IndexSlot
+{
+    uint64_t key; // 0 is empty
+    uint64_t record; // Its number in the log
+};
+
+class FitnessDB
+{
+public:
+    FitnessDB();
+    ~FitnessDB();
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const { return log_fd >= 0; }
+    bool find(const uint64_t genome, const uint64_t data,
+              const uint64_t config, FitRecord &rec);
+    void add(const std::vector<FitRecord> &recs);
+    std::vector<FitRecord> best(const uint64_t config, const int n);
+    long size();
+
+private:
+    struct IndexHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t capacity, count;
+        char pad[40];
+    };
+
+    int log_fd, idx_fd;
+    IndexHeader *ih; // Mapped index
+    IndexSlot *slots;
+    uint64_t mapped; // Capacity of the current mapping
+    std::mutex m;
+
+    void lock();
+    void unlock();
+    long records();
+    bool map(const uint64_t capacity);
+    void sync();
+    void rebuild(uint64_t capacity);
+    void insert(const uint64_t key, const uint64_t record);
+};
+
+extern FitnessDB FITNESS_DB;
+
+uint64_t hash_bytes(const void *p, const size_t n, uint64_t h = 0);
+uint64_t genome_hash(const Genome &g);
+uint64_t data_hash(const MatrixXd &x, const MatrixXd &y);
+uint64_t config_hash();
+
+#endif
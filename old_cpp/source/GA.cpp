@@ -1,12 +1,27 @@
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <vector>
 #include <cmath>
+#include <limits>
+#include <chrono>
 #define EIGEN_USE_MKL_ALL
 #include <Eigen/Dense>
 #include "Retina.h"
 #include "tool.h"
 #include "GA.h"
+#include "Log.h"
+#include "Profile.h"
+#include "Arena.h"
+#include "Threads.h"
+#include "Stimuli.h"
+#include "Pareto.h"
+#include "CMAES.h"
+#include "FitnessDB.h"
+#include "Niche.h"
+#include "Recorder.h"
+
+#define NICHE_DUPLICATES 4 // Neighbours checked for a repeated genome
 
 #define expth(x) (1.0e3 * exp((x - 4.0e4) / 1.0e3) - exp(-4.0e4 / 1.0e3))
 
@@ -22,29 +37,244 @@ GA::GA(Genome *genomes, Retina *retinas)
 {
     g = genomes;
     r = retinas;
-    for (int i = 0; i < POPULATION; i++) g[i].r = &r[i];
+    file = nullptr;
+    stimuli = nullptr;
+    n_evals = 0;
+    config_id = file_id = 0;
+    db_hits = db_misses = 0;
+    accuracy = ModelStats();
+    for (int i = 0; i < POPULATION; i++)
+    {
+        g[i].r = &r[i];
+        g[i].dirty = ALL_LAYERS;
+    }
 
     children = new Genome[POPULATION - ELITES];
     p1 = new int[POPULATION - ELITES];
     p2 = new int[POPULATION - ELITES];
 }
 
-void GA::eval(const MatrixXd &x, const MatrixXd &y)
+// run() is not the only entry point: score() and refine() need no run()
+GA::~GA()
 {
-    for (int i = 0; i < POPULATION; i++)
+    delete[] children;
+    delete[] p1;
+    delete[] p2;
+}
+
+// Evaluate on `data` STREAM_ROWS rows at a time; run() then ignores x, y
+void GA::stream(const DataFile *data)
+{
+    file = data;
+    if (!FITNESS_DB.is_open()) return;
+
+    // The file is never held whole; hash it a chunk at a time
+    MatrixXd sigs, st;
+    long chunk = std::max(1, STREAM_ROWS);
+    file_id = hash_bytes(&chunk, sizeof(chunk));
+    for (long r0 = 0; r0 < file->rows(); r0 += chunk)
+    {
+        file->read(r0, std::min(chunk, file->rows() - r0), sigs, st);
+        uint64_t h = data_hash(sigs, st);
+        file_id = hash_bytes(&h, sizeof(h), file_id);
+    }
+}
+
+/*
+ * fit_cost and total_cost of the n genomes of pop, built by init(). With
+ * FITNESS_DB open, genomes already evaluated on this data under these
+ * settings take the stored results; the rest are computed and stored.
+ */
+void GA::eval(const MatrixXd &x, const MatrixXd &y, Genome *pop,
+              const int n)
+{
+    if (!FITNESS_DB.is_open())
+    {
+        compute(x, y, pop, n);
+        return;
+    }
+
+    uint64_t data = file? file_id : stimuli? stimuli->hash() : data_hash(x, y);
+    std::vector<Genome> miss;
+    std::vector<int> at;
+    std::vector<uint64_t> hash(n);
+    for (int i = 0; i < n; i++)
+    {
+        FitRecord rec;
+        hash[i] = genome_hash(pop[i]);
+        if (FITNESS_DB.find(hash[i], data, config_id, rec))
+        {
+            pop[i].fit_cost = pop[i].total_cost = rec.fit_cost;
+            continue;
+        }
+        miss.push_back(pop[i]);
+        at.push_back(i);
+    }
+    db_hits += n - miss.size();
+    db_misses += miss.size();
+    if (miss.empty()) return;
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point t0 = clock::now();
+    compute(x, y, miss.data(), miss.size());
+    float seconds = std::chrono::duration<double>(clock::now() - t0).count()
+                    / miss.size();
+
+    std::vector<FitRecord> recs(miss.size());
+    for (size_t k = 0; k < miss.size(); k++)
+    {
+        Genome &p = pop[at[k]];
+        p.fit_cost = miss[k].fit_cost;
+        p.total_cost = miss[k].total_cost;
+
+        recs[k].genome = hash[at[k]];
+        recs[k].data = data;
+        recs[k].config = config_id;
+        recs[k].fit_cost = p.fit_cost;
+        recs[k].n_synapses = p.n_synapses;
+        recs[k].seconds = seconds;
+        recs[k].g = record(p);
+    }
+    FITNESS_DB.add(recs);
+}
+
+/*
+ * Builds and evaluates the first n genomes of the population as a
+ * generation would, without ranking or breeding them. For Server, which
+ * fills the population with the genomes it is sent.
+ */
+void GA::score(const MatrixXd &x, const MatrixXd &y, const int n)
+{
+    ARENA.reset();
+    checks.clear(); // Not logged
+    if (FITNESS_DB.is_open() && config_id == 0) config_id = config_hash();
+
+    for (int j = 0; j < n; j++)
+    {
+        {
+            PROFILE_SCOPE(PH_ORGANIZE);
+            g[j].organize();
+        }
+        PROFILE_SCOPE(PH_INIT);
+        g[j].r->init(g[j]);
+    }
+
+    eval(x, y, g, n);
+}
+
+// eval() without the store
+void GA::compute(const MatrixXd &x, const MatrixXd &y, Genome *pop,
+                 const int n)
+{
+    if (file)
+    {
+        eval_stream(pop, n);
+        return;
+    }
+
+    // Split this GA's share of the cores across genomes or across rows
+    int cores = INNER_THREADS;
+    int mode = EVAL_PARALLEL;
+    if (mode == PAR_AUTO)
+    {
+        if (cores == 1) mode = PAR_SERIAL;
+        // Whole evaluations per core, unless a few huge genomes would idle
+        // most cores while rows are plentiful
+        else if (n >= 4 * cores || x.rows() < 64 * cores)
+            mode = PAR_GENOMES;
+        else mode = PAR_ROWS;
+    }
+    int row_threads = (mode == PAR_ROWS)? cores : 1;
+
+    // The fixed-T react of the whole population, a few wide GEMMs per step;
+    // not for 2-D layers, whose sparse edges react_fixed uses instead
+    std::vector<MatrixXd> retina_out(n);
+    std::vector<double> bound(n, 0);
+    bool batch = REACT_BATCH > 0 && REACT_TOL == 0 && REACT_K == 1 && !MOSAIC;
+    if (batch) Retina::react_batch(x, pop, n, retina_out.data(), cores);
+
+    PROFILE_OWNER;
+    Arena &owner = ARENA;
+    #pragma omp parallel num_threads(cores) if (mode == PAR_GENOMES)
+    {
+        #pragma omp for schedule(dynamic)
+        for (int i = 0; i < n; i++)
+        {
+            if (!batch)
+                pop[i].r->react(x, retina_out[i], pop[i], row_threads,
+                                &bound[i]);
+
+            double test_out = readout(retina_out[i], y, row_threads);
+
+            pop[i].fit_cost = test_out; //(DICISION_BOUNDARY == 0)? test_out : (1 - test_out);
+            // double cs = expth(pop[i].n_synapses);
+            // if (cs < 1e-3) cs = 0;
+            pop[i].total_cost = pop[i].fit_cost;
+        }
+        PROFILE_MERGE;
+        ARENA.settle(owner);
+    }
+
+    // Every REACT_CHECK-th genome evaluated, wherever it is in pop
+    if ((REACT_TOL > 0 || REACT_K > 1) && REACT_CHECK > 0)
+        for (int i = 0; i < n; i++)
+            if (n_evals++ % REACT_CHECK == 0)
+                check_react(x, pop[i], retina_out[i], bound[i]);
+}
+
+
+// eval with every genome's react and nn run chunk by chunk, a genome per
+// thread. Each row is reacted once, STREAM_ROWS at a time, into a
+// SpillFile of the ganglion rates that nn_stream's epochs then read, so
+// memory stays bounded without simulating again every epoch.
+void GA::eval_stream(Genome *pop, const int n)
+{
+    int cores = INNER_THREADS;
+    const long rows = file->rows(), chunk = std::max(1, STREAM_ROWS);
+
+    PROFILE_OWNER;
+    Arena &owner = ARENA;
+    #pragma omp parallel num_threads(cores) if (cores > 1)
     {
-        MatrixXd retina_out;
-        g[i].r->react(x, retina_out, g[i]);
+        #pragma omp for schedule(dynamic)
+        for (int i = 0; i < n; i++)
+        {
+            int n_out = pop[i].n_cell[pop[i].n_types - 1];
+            SpillFile out(FOLDER, rows, n_out);
+
+            MatrixXd sigs, st, x;
+            for (long r0 = 0; r0 < rows; r0 += chunk)
+            {
+                file->read(r0, std::min(chunk, rows - r0), sigs, st);
+                pop[i].r->react(sigs, x, pop[i]);
+                out.write(r0, x);
+            }
 
-        double test_out = nn(retina_out, y);
+            RowSource spilled = [&](const long r0, const int nr, MatrixXd &x,
+                                    MatrixXd &y)
+            {
+                file->read(r0, nr, y);
+                out.read(r0, nr, x);
+            };
 
-        g[i].fit_cost = test_out; //(DICISION_BOUNDARY == 0)? test_out : (1 - test_out);
-        // double cs = expth(g[i].n_synapses);
-        // if (cs < 1e-3) cs = 0;
-        g[i].total_cost = g[i].fit_cost;
+            pop[i].fit_cost = nn_stream(spilled, rows, n_out,
+                                        file->targets(), STREAM_ROWS);
+            pop[i].total_cost = pop[i].fit_cost;
+        }
+        PROFILE_MERGE;
+        ARENA.settle(owner);
     }
 }
 
+// Error of p's fast react, out, against the fixed-T Euler reference, kept
+// with the bound react gave for the log
+void GA::check_react(const MatrixXd &x, const Genome &p, const MatrixXd &out,
+                     const double bound)
+{
+    MatrixXd ref;
+    p.r->react_fixed(x, ref, p);
+    checks.push_back({bound, (out - ref).cwiseAbs().maxCoeff()});
+}
 
 int comparator(const void *r1, const void *r2)
 {
@@ -69,13 +299,27 @@ int comparator(const void *r1, const void *r2)
 
 int GA::select_p(const int p_)
 {
+    // Children screen() passed over were never evaluated and have no part
+    // in the next generation: rivals come from the evaluated genomes, which
+    // rank() put first, while there are enough of them
+    int n = 0;
+    while (n < POPULATION && !g[n].screened) n++;
+    if (n < 3) n = POPULATION;
+
     int p, rival1, rival2;
     do
     {// Randomly select two rivals
-        rival1 = uniform(0, POPULATION - 1);
-        rival2 = uniform(0, POPULATION - 1);
+        rival1 = uniform(0, n - 1);
+        rival2 = uniform(0, n - 1);
     } while (rival1 == rival2 || rival1 == p_ || rival2 == p_);
 
+    // A screened rival's total_cost is inf, and inf / inf would let it win
+    if (g[rival1].screened != g[rival2].screened)
+        return g[rival1].screened? rival2 : rival1;
+
+    // Crowded-comparison tournament
+    if (PARETO) return pareto_better(g[rival2], g[rival1])? rival2 : rival1;
+
     double ratio1 = g[rival1].total_cost /
                     (g[rival1].total_cost + g[rival2].total_cost);
 
@@ -86,6 +330,7 @@ int GA::select_p(const int p_)
 
 void GA::selection()
 {
+    PROFILE_SCOPE(PH_SELECT);
     for (int i = 0; i < POPULATION - ELITES; i++)
     { // Choose each child's parents
         p1[i] = select_p(-1);
@@ -95,6 +340,7 @@ void GA::selection()
 
 void GA::crossover()
 {
+    PROFILE_SCOPE(PH_CROSSOVER);
     // Crossover, results stored in buffer
     for (int i = 0; i < POPULATION - ELITES; i++)
     {
@@ -133,12 +379,20 @@ void GA::crossover()
     {
         if (uniform(0, 99) > XRATE) continue; // crossover is binomial
 
+        if (g[k].n_types != children[i].n_types) g[k].dirty = ALL_LAYERS;
         g[k].n_types = children[i].n_types;
 
         g[k].th = children[i].th;
 
         for (int j = 0; j < MAX_TYPES; j++)
         {
+            if (g[k].axon[j] != children[i].axon[j] ||
+                g[k].dendrite[j] != children[i].dendrite[j] ||
+                g[k].n_cell[j] != children[i].n_cell[j] ||
+                g[k].phi[j] != children[i].phi[j] ||
+                g[k].beta[j] != children[i].beta[j])
+                g[k].dirty |= 1u << j;
+
             g[k].axon[j] = children[i].axon[j];
             g[k].dendrite[j] = children[i].dendrite[j];
             // g[k].polarity[j] = children[i].polarity[j];
@@ -158,101 +412,398 @@ void mutate_single(double &var, const double lo, const double hi)
     else if (var > hi) var = hi;
 }
 
+// Small steps of every parameter of g, and at times a cell more or less
+// in an interneuron layer
+static void mutate(Genome &g)
+{
+    int n = g.n_types;
+
+    for (int j = 0; j < n; j++)
+    {
+        // Mutate axon/dendrite, in very small amount per time
+        mutate_single(g.axon[j], 0.0, M_PI * 2);
+        mutate_single(g.dendrite[j], 0.0, M_PI * 2);
+
+        // Mutate phi, in very small amount per time
+        mutate_single(g.phi[j], 0.0, 0.5);
+
+        // Mutate beta, in very small amount per time
+        mutate_single(g.beta[j], -0.5, 0.5);
+        g.dirty |= 1u << j;
+
+        // Mutate resistance, in very small amount per time
+        if (j != 0) mutate_single(g.resistance[j], 0.0, 2.0);
+
+        // 0.1 probability the polarity will flip
+        // if (uniform(0, 99) < 10 && j > 0) g.polarity[j]  = -g.polarity[j];
+
+        // Skip receptor and ganglion cells
+        if (j == 0 || j == n - 1) continue;
+
+        // 0.05 probability the number of cells will decrease/increase by 1
+        if (uniform(0, 99) < 5)
+        {
+            int max_cell = CELLS;// (j == n - 1)? CELLS / 2 : CELLS;
+            if (++g.n_cell[j] > CELLS) g.n_cell[j] = max_cell;
+        } else if (uniform(0, 99) < 10)
+        {
+            int min_cell = 0;//(j == n - 1)? CELLS / 10 : 0;
+            if (--g.n_cell[j] < min_cell) g.n_cell[j] = min_cell;
+        }
+    }
+
+    // Mutate ganglion firing threshold, in very small amount per time
+    mutate_single(g.th, 0.6, 1.0);
+
+    // Force the receptog to have excitatory projections
+    // if (g.polarity[0] < 0)
+    //     g.polarity[0] = fabs(g.polarity[0]);
+}
+
 void GA::mutation()
 {
+    PROFILE_SCOPE(PH_MUTATE);
+    for (int i = ELITES; i < POPULATION; i++) mutate(g[i]);
+}
+
+void GA::start_competition(const MatrixXd &x, const MatrixXd &y)
+{
+    ARENA.reset(); // Merge whatever the last generation chained
+
+    {
+        PROFILE_SCOPE(PH_ORGANIZE);
+        for (int j = 0; j < POPULATION; j++) g[j].organize();
+    }
+
+    if (NICHE > 0) distinct();
+
+    // Only the first n are built and evaluated
+    predicted.clear();
+    int n = (SURROGATE > 0 && model.samples() > 0)? screen() : POPULATION;
+
+    for (int j = 0; j < n; j++)
+    {
+        PROFILE_SCOPE(PH_INIT);
+        g[j].r->init(g[j]);
+    }
+
+    eval(x, y, g, n);
+
+    if (SURROGATE > 0) train(n);
+
+    if (NICHE > 0) share(n);
+
+    rank();
+}
+
+// Children that repeat a genome before them, elites first, are mutated
+// once more instead of costing an evaluation of a known genome
+void GA::distinct()
+{
+    PROFILE_SCOPE(PH_NICHE);
+    index.build(g, POPULATION);
+
+    int idx[NICHE_DUPLICATES];
+    double dist[NICHE_DUPLICATES];
     for (int i = ELITES; i < POPULATION; i++)
     {
-        int n = g[i].n_types;
-        // std::cout << i << " " << n << std::endl;
+        int m = index.knn(i, NICHE_DUPLICATES, idx, dist);
+        for (int k = 0; k < m && dist[k] < 1e-9; k++)
+        {
+            if (idx[k] > i) continue;
+            mutate(g[i]);
+            g[i].organize();
+            break;
+        }
+    }
+}
 
-        for (int j = 0; j < n; j++)
+/*
+ * Fitness sharing among the n genomes evaluated: total_cost is fit_cost
+ * times the niche count 1 + sum of (1 - d / NICHE_RADIUS) over the NICHE
+ * nearest genomes closer than NICHE_RADIUS, so crowded genomes rank lower.
+ * Pareto ranking reads fit_cost and is left alone.
+ */
+void GA::share(const int n)
+{
+    PROFILE_SCOPE(PH_NICHE);
+    index.build(g, n);
+
+    std::vector<int> idx(NICHE);
+    std::vector<double> dist(NICHE);
+    std::vector<double> count(n, 1);
+    for (int i = 0; i < n; i++)
+    {
+        int m = index.knn(i, NICHE, idx.data(), dist.data());
+        for (int k = 0; k < m && dist[k] < NICHE_RADIUS; k++)
+            count[i] += 1 - dist[k] / NICHE_RADIUS;
+    }
+    for (int i = 0; i < n; i++) g[i].total_cost = g[i].fit_cost * count[i];
+}
+
+/*
+ * Orders the children by the surrogate's fit_cost and keeps the best
+ * SURROGATE of them, plus SURROGATE_EXPLORE of them at random so that the
+ * model keeps seeing what it rates badly. The kept move up to follow the
+ * elites; the rest are marked screened and rank last. Returns the number
+ * of genomes to evaluate.
+ */
+int GA::screen()
+{
+    const int n_children = POPULATION - ELITES;
+    if (n_children <= 0) return POPULATION;
+
+    model.fit();
+
+    std::vector<std::pair<double, int> > order(n_children);
+    for (int k = 0; k < n_children; k++)
+        order[k] = std::make_pair(model.predict(g[ELITES + k]), ELITES + k);
+    std::sort(order.begin(), order.end());
+
+    int n_best = std::min(n_children, (int) ceil(SURROGATE * n_children));
+    int n_explore = std::min(n_children - n_best,
+                             (int) round(SURROGATE_EXPLORE * n_children));
+    for (int k = n_best; k < n_best + n_explore; k++)
+        std::swap(order[k], order[uniform(k, n_children - 1)]);
+
+    std::vector<Genome> moved(n_children);
+    for (int k = 0; k < n_children; k++) moved[k] = g[order[k].second];
+
+    int n_eval = n_best + n_explore;
+    predicted.resize(n_eval);
+    for (int k = 0; k < n_children; k++)
+    {
+        Genome &c = g[ELITES + k];
+        c = moved[k];
+        c.screened = k >= n_eval;
+        if (c.screened)
         {
-            // Mutate axon/dendrite, in very small amount per time
-            mutate_single(g[i].axon[j], 0.0, M_PI * 2);
-            mutate_single(g[i].dendrite[j], 0.0, M_PI * 2);
+            c.fit_cost = std::numeric_limits<double>::quiet_NaN();
+            c.total_cost = std::numeric_limits<double>::infinity();
+        }
+        else predicted[k] = order[k].first;
+    }
 
-            // Mutate phi, in very small amount per time
-            mutate_single(g[i].phi[j], 0.0, 0.5);
+    return ELITES + n_eval;
+}
 
-            // Mutate beta, in very small amount per time
-            mutate_single(g[i].beta[j], -0.5, 0.5);
+// Feeds the n genomes just evaluated to the surrogate, and keeps how well
+// it predicted the children among them for the log
+void GA::train(const int n)
+{
+    accuracy = ModelStats();
+    double err = 0, sp = 0, sa = 0, spp = 0, saa = 0, spa = 0;
+    int m = 0;
 
-            // Mutate resistance, in very small amount per time
-            if (j != 0) mutate_single(g[i].resistance[j], 0.0, 2.0);
+    for (int j = 0; j < n; j++) g[j].screened = false;
 
-            // 0.1 probability the polarity will flip
-            // if (uniform(0, 99) < 10 && j > 0) g[i].polarity[j]  = -g[i].polarity[j];
+    // The elites went in when they were children
+    for (int j = (model.samples() > 0)? ELITES : 0; j < n; j++)
+    {
+        model.add(g[j], g[j].fit_cost);
+
+        if (predicted.empty() || g[j].fit_cost != g[j].fit_cost) continue;
+        double p = predicted[j - ELITES], a = g[j].fit_cost;
+        err += fabs(p - a);
+        sp += p; sa += a; spp += p * p; saa += a * a; spa += p * a;
+        m++;
+    }
 
-            // Skip receptor and ganglion cells
-            if (j == 0 || j == n - 1) continue;
+    if (m == 0) return;
 
-            // 0.05 probability the number of cells will decrease/increase by 1
-            if (uniform(0, 99) < 5)
+    double cov = spa - sp * sa / m;
+    double var = (spp - sp * sp / m) * (saa - sa * sa / m);
+    accuracy.n = m;
+    accuracy.mae = err / m;
+    accuracy.corr = (var > 0)? cov / sqrt(var) : 0;
+}
+
+// Sort the retinas; the elites are the first ELITES
+void GA::rank()
+{
+    PROFILE_SCOPE(PH_RANK);
+    if (PARETO) pareto_rank(g, POPULATION);
+    qsort(g, POPULATION, sizeof(Genome), PARETO? pareto_comparator : comparator);
+}
+
+// Visits the continuous parameters of g, with their ranges in mutation().
+// Resistance stays above organize()'s cut-off, so no layer is removed.
+template <typename F>
+static void continuous(Genome &g, F f)
+{
+    for (int j = 0; j < g.n_types; j++)
+    {
+        f(g.axon[j], 0.0, M_PI * 2);
+        f(g.dendrite[j], 0.0, M_PI * 2);
+        f(g.phi[j], 0.0, 0.5);
+        f(g.beta[j], -0.5, 0.5);
+        if (j != 0) f(g.resistance[j], 1e-3, 2.0);
+    }
+    f(g.th, 0.6, 1.0);
+}
+
+/*
+ * CMA-ES on the continuous parameters of each of the CMAES_ELITES best
+ * genomes, with their structure fixed, each parameter scaled to [0, 1].
+ * Every iteration's batch of candidates goes through eval() together. An
+ * elite takes the best candidate if that beats it on fit_cost, which
+ * unlike total_cost is not shared out among the elite's niche, and its
+ * retina is rebuilt. Sharing is then redone before ranking.
+ */
+void GA::refine(const MatrixXd &x, const MatrixXd &y)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+
+    for (int e = 0; e < std::min(CMAES_ELITES, ELITES); e++)
+    {
+        std::vector<double> v;
+        continuous(g[e], [&](double &p, const double lo, const double hi)
+                   { v.push_back((p - lo) / (hi - lo)); });
+
+        CMAES es(Eigen::Map<VectorXd>(v.data(), v.size()), 0.05,
+                 CMAES_LAMBDA);
+        cand.resize(es.lambda);
+        cand_r.resize(es.lambda);
+
+        Genome best = g[e];
+        double best_cost = (g[e].fit_cost != g[e].fit_cost)?
+                           inf : g[e].fit_cost;
+        MatrixXd X;
+        VectorXd cost(es.lambda);
+
+        for (int it = 0; it < CMAES_ITERS; it++)
+        {
+            es.sample(X);
+            for (int k = 0; k < es.lambda; k++)
             {
-                int max_cell = CELLS;// (j == n - 1)? CELLS / 2 : CELLS;
-                if (++g[i].n_cell[j] > CELLS) g[i].n_cell[j] = max_cell;
-            } else if (uniform(0, 99) < 10)
+                Genome &c = cand[k];
+                c = g[e];
+                c.r = &cand_r[k];
+
+                int i = 0;
+                continuous(c, [&](double &p, const double lo, const double hi)
+                           { p = lo + std::min(1.0, std::max(0.0, X(i++, k)))
+                                      * (hi - lo); });
+
+                c.dirty = ALL_LAYERS; // Its retina was some other candidate
+                c.organize();
+                c.r->init(c);
+            }
+
+            eval(x, y, cand.data(), es.lambda);
+
+            for (int k = 0; k < es.lambda; k++)
             {
-                int min_cell = 0;//(j == n - 1)? CELLS / 10 : 0;
-                if (--g[i].n_cell[j] < min_cell) g[i].n_cell[j] = min_cell;
+                double fc = cand[k].fit_cost;
+                cost(k) = (fc != fc)? inf : fc;
+                if (cost(k) >= best_cost) continue;
+                best = cand[k];
+                best_cost = cost(k);
             }
+            es.tell(X, cost);
         }
 
-        // Mutate ganglion firing threshold, in very small amount per time
-        mutate_single(g[i].th, 0.6, 1.0);
+        if (best.r == g[e].r) continue; // Not improved
 
-        // Force the receptog to have excitatory projections
-        // if (g[i].polarity[0] < 0)
-        //     g[i].polarity[0] = fabs(g[i].polarity[0]);
+        Retina *r = g[e].r;
+        g[e] = best;
+        g[e].r = r;
+        g[e].dirty = ALL_LAYERS;
+        g[e].n_synapses = 0; // Counted already when best's retina was built
+        r->init(g[e]); // Still held the weights it was replaced for
     }
-}
 
-void GA::start_competition(const MatrixXd &x, const MatrixXd &y)
-{
-    for (int j = 0; j < POPULATION; j++)
+    // Candidates' total_cost is their fit_cost; share it again among the
+    // evaluated genomes, which rank() put before the screened ones
+    if (NICHE > 0)
     {
-        g[j].organize();
-        g[j].r->init(g[j]);
+        int n = 0;
+        while (n < POPULATION && !g[n].screened) n++;
+        share(n);
     }
 
-    eval(x, y);
+    rank();
+}
 
-    // Sort the retinas
-    qsort(g, POPULATION, sizeof(Genome), comparator);
+// The first DB_SEED genomes become the best FITNESS_DB holds under these
+// settings, whatever data they were evaluated on
+void GA::seed()
+{
+    std::vector<FitRecord> best = FITNESS_DB.best(config_id,
+                                                  std::min(DB_SEED, POPULATION));
+    for (size_t k = 0; k < best.size(); k++) restore(g[k], best[k].g);
+}
+
+// Dynamics of the RECORD_GENOMES best genomes on the first RECORD_ROWS test
+// rows, reacted again with the fixed-T Euler steps
+void GA::record_dynamics(const MatrixXd &x, const int tid)
+{
+    long rows = file? file->rows() : x.rows();
+    int r0 = rows - TEST_SIZE, m = std::min(RECORD_ROWS, TEST_SIZE);
+    if (m <= 0) return;
+
+    MatrixXd in, st, out;
+    if (file) file->read(r0, m, in, st);
+    else in = x.middleRows(r0, m);
+
+    std::vector<int> ids(m);
+    for (int k = 0; k < m; k++) ids[k] = r0 + k;
+
+    for (int e = 0; e < std::min(RECORD_GENOMES, POPULATION); e++)
+    {
+        Probe probe = {(uint32_t) (tid * 65536 + e), ids.data(), RECORD_EVERY};
+        g[e].r->react_fixed(in, out, g[e], &probe);
+    }
 }
 
 void GA::run(const MatrixXd &x, const MatrixXd &y, const int tid = 0)
 {
-    // Open a log
-    std::ofstream f(FOLDER + "/" + "log" + std::to_string(tid) + ".tsv");
+    // Open a log; stats are written and progress printed in the background
+    Logger f(FOLDER + "/" + "log" + std::to_string(tid), tid, LOG_FORMAT,
+             SURROGATE > 0,
+             (REACT_TOL > 0 || REACT_K > 1) && REACT_CHECK > 0 && !file);
+    PROF.reset();
+
+    if (FITNESS_DB.is_open())
+    {
+        config_id = config_hash();
+        if (DB_SEED > 0) seed();
+    }
+
+    // Fresh stimuli every REFRESH generations, produced in the background
+    Stimuli data(x, y, (REFRESH > 0 && !file)? REFRESH_FRAC : 0);
+    stimuli = &data;
 
     for (int i = 0; i < ITERS; i++)
     {
-        std::cout << "[" << tid << "]" << i + 1 << std::endl;
+        start_competition(data.sigs(), data.st());
 
-        start_competition(x, y);
+        if (CMAES_EVERY > 0 && (i + 1) % CMAES_EVERY == 0)
+            refine(data.sigs(), data.st());
 
-        // Output stats
-        for (int j = 0; j < POPULATION; j++)
-        {
-            f << g[j].fit_cost << "\t" << g[j].n_synapses << "\t"
-              << "\t" << g[j].i2e << "\n";
-        }
-        f << "\n";
+        // Output stats, with the phase profile of this generation so far
+        f.push(i, g, POPULATION, accuracy, checks);
+        checks.clear();
 
         selection();
 
         crossover();
 
         mutation();
+
+        if ((i + 1) % std::max(1, REFRESH) == 0) data.swap();
 	}
 
     // eval and sort the final retinas
-    start_competition(x, y);
+    start_competition(data.sigs(), data.st());
+
+    if (RECORDER.is_open()) record_dynamics(data.sigs(), tid);
+    stimuli = nullptr;
 
 	f.close();
+    trace_write(FOLDER + "/" + "trace" + std::to_string(tid) + ".json", tid);
 
-    delete[] children;
-    delete[] p1;
-    delete[] p2;
+    if (FITNESS_DB.is_open())
+        std::cout << "[" << tid << "]fitness db hits " << db_hits << " of "
+                  << db_hits + db_misses << std::endl;
 }
@@ -1,27 +1,72 @@
 #ifndef GA_H
 #define GA_H
 
+#include <vector>
 #define EIGEN_USE_MKL_ALL
 #include <Eigen/Dense>
 #include "Retina.h"
+#include "Dataset.h"
+#include "Surrogate.h"
+#include "FitnessDB.h"
+#include "Niche.h"
+#include "Log.h"
+
+class Stimuli;
+
+// Parallelism inside one GA's evaluation
+#define PAR_AUTO 0
+#define PAR_SERIAL 1
+#define PAR_GENOMES 2 // Genomes on different threads
+#define PAR_ROWS 3 // Row blocks of each genome's react and nn
 
 class GA
 {
 public:
     GA(Genome *g, Retina *r);
+    ~GA();
+    GA(const GA &) = delete; // Owns children, p1 and p2
+    GA &operator=(const GA &) = delete;
     void run(const MatrixXd &x, const MatrixXd &y, const int tid);
+    void stream(const DataFile *data);
+    void score(const MatrixXd &x, const MatrixXd &y, const int n);
+    void refine(const MatrixXd &x, const MatrixXd &y); // Public for check
+    int select_p(const int p_); // Public for check
 
 private:
     int *p1, *p2;
+    int n_evals;
     Genome *g, *children;
     Retina *r;
+    const DataFile *file; // Streamed instead of x and y, if set
+    Stimuli *stimuli; // run()'s, whose hash eval() reuses; else x, y are hashed
+    uint64_t config_id, file_id; // Of FITNESS_DB keys
+    long db_hits, db_misses;
+    std::vector<Genome> cand; // CMA-ES candidates
+    std::vector<Retina> cand_r;
+    Surrogate model; // Of fit_cost, trained if SURROGATE
+    std::vector<double> predicted; // Of the children screen() let through
+    ModelStats accuracy; // Of the surrogate on them, for the log
+    GenomeIndex index; // Of the population, for niching
+    std::vector<ReactCheck> checks; // Of this generation, for the log
 
-    void eval(const MatrixXd &x, const MatrixXd &y);
-    int select_p(const int p_);
+    void eval(const MatrixXd &x, const MatrixXd &y, Genome *pop,
+              const int n);
+    void compute(const MatrixXd &x, const MatrixXd &y, Genome *pop,
+                 const int n);
+    void eval_stream(Genome *pop, const int n);
+    void check_react(const MatrixXd &x, const Genome &p, const MatrixXd &out,
+                     const double bound);
     void selection();
     void crossover();
     void mutation();
     void start_competition(const MatrixXd &x, const MatrixXd &y);
+    int screen();
+    void train(const int n);
+    void distinct();
+    void share(const int n);
+    void rank();
+    void seed();
+    void record_dynamics(const MatrixXd &x, const int tid);
 };
 
 #endif
@@ -0,0 +1,203 @@
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <zlib.h>
+#include "Log.h"
+
+#define LOG_VERSION 1
+#define LOG_FIELDS 3
+
+Logger::Logger(const std::string &fname, const int tid_, const int format_,
+               const bool model_, const bool react_)
+    : tid(tid_), format(format_), model(model_), react(react_), head(0),
+      tail(0), done(false)
+{
+    if (format == LOG_TSV)
+    {
+        f.open(fname + ".tsv");
+    }
+    else
+    {
+        f.open(fname + ".bin", std::ios::binary);
+
+        uint32_t flags = (format == LOG_BINZ);
+        if (model) flags |= 4;
+        if (react) flags |= 8;
+#ifdef PROFILE
+        flags |= 2;
+#endif
+        uint32_t hdr[4] = {LOG_VERSION, (uint32_t) tid, LOG_FIELDS, flags};
+        f.write("RLOG", 4);
+        f.write((const char *) hdr, sizeof(hdr));
+    }
+
+    writer = std::thread(&Logger::drain, this);
+}
+
+Logger::~Logger()
+{
+    close();
+}
+
+void Logger::push(const int gen, const Genome *g, const int n,
+                  const ModelStats &model, const std::vector<ReactCheck> &checks)
+{
+    unsigned h = head.load(std::memory_order_relaxed);
+    Record &rec = buf[h % LOG_SLOTS];
+
+    // Timed before the profile is taken, so that it counts in this one
+    {
+        PROFILE_SCOPE(PH_LOG);
+
+        // Back-pressure: wait for the writer if the ring is full
+        while (h - tail.load(std::memory_order_acquire) >= LOG_SLOTS)
+            std::this_thread::yield();
+
+        rec.gen = gen;
+        rec.model = model;
+        rec.checks = checks;
+        rec.fit_cost.resize(n);
+        rec.n_synapses.resize(n);
+        rec.i2e.resize(n);
+
+        for (int j = 0; j < n; j++)
+        {
+            rec.fit_cost[j] = g[j].fit_cost;
+            rec.n_synapses[j] = g[j].n_synapses;
+            rec.i2e[j] = g[j].i2e;
+        }
+    }
+
+#ifdef PROFILE
+    rec.prof = PROF;
+    PROF.reset();
+#endif
+
+    head.store(h + 1, std::memory_order_release);
+}
+
+void Logger::close()
+{
+    if (!writer.joinable()) return;
+
+    done.store(true, std::memory_order_release);
+    writer.join();
+    f.close();
+}
+
+void Logger::drain()
+{
+    unsigned t = tail.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        if (t == head.load(std::memory_order_acquire))
+        {
+            // Re-check after seeing done, since the last push may race it
+            if (done.load(std::memory_order_acquire) &&
+                t == head.load(std::memory_order_acquire))
+                break;
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        const Record &rec = buf[t % LOG_SLOTS];
+        write_block(rec);
+        std::cout << "[" << tid << "]" << rec.gen + 1 << std::endl;
+
+        tail.store(++t, std::memory_order_release);
+    }
+}
+
+void Logger::write_block(const Record &rec)
+{
+    int n = rec.fit_cost.size();
+
+    if (format == LOG_TSV)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            f << rec.fit_cost[j] << "\t" << rec.n_synapses[j] << "\t"
+              << "\t" << rec.i2e[j] << "\n";
+        }
+        if (model)
+        {
+            f << "#model\t" << rec.model.n << "\t" << rec.model.mae << "\t"
+              << rec.model.corr << "\n";
+        }
+        for (const ReactCheck &c : rec.checks)
+            f << "#react\t" << c.bound << "\t" << c.error << "\n";
+        f << "\n";
+        return;
+    }
+
+    // Columns back to back
+    uint64_t raw_bytes = n * (2 * sizeof(double) + sizeof(int32_t));
+    std::vector<char> raw(raw_bytes);
+    char *p = raw.data();
+    std::memcpy(p, rec.fit_cost.data(), n * sizeof(double));
+    p += n * sizeof(double);
+    std::memcpy(p, rec.n_synapses.data(), n * sizeof(int32_t));
+    p += n * sizeof(int32_t);
+    std::memcpy(p, rec.i2e.data(), n * sizeof(double));
+
+    const char *payload = raw.data();
+    uint64_t stored_bytes = raw_bytes;
+
+    std::vector<char> packed;
+    if (format == LOG_BINZ)
+    {
+        // A block that fails to compress, or does not shrink, is stored
+        // raw; stored_bytes == raw_bytes tells the reader which
+        uLongf len = compressBound(raw_bytes);
+        packed.resize(len);
+        int err = compress2((Bytef *) packed.data(), &len,
+                            (const Bytef *) raw.data(), raw_bytes,
+                            Z_DEFAULT_COMPRESSION);
+        if (err == Z_OK && len < raw_bytes)
+        {
+            payload = packed.data();
+            stored_bytes = len;
+        }
+        else if (err != Z_OK)
+        {
+            std::cerr << "[" << tid << "] log: generation " << rec.gen
+                      << " stored uncompressed, zlib error " << err
+                      << std::endl;
+        }
+    }
+
+    int32_t gn[2] = {rec.gen, n};
+    f.write((const char *) gn, sizeof(gn));
+    f.write((const char *) &raw_bytes, sizeof(raw_bytes));
+    f.write((const char *) &stored_bytes, sizeof(stored_bytes));
+    f.write(payload, stored_bytes);
+
+    if (model)
+    {
+        int32_t m = rec.model.n;
+        double s[2] = {rec.model.mae, rec.model.corr};
+        f.write((const char *) &m, sizeof(m));
+        f.write((const char *) s, sizeof(s));
+    }
+
+    if (react)
+    {
+        int32_t k = rec.checks.size();
+        f.write((const char *) &k, sizeof(k));
+        for (const ReactCheck &c : rec.checks)
+            f.write((const char *) &c.bound, sizeof(c.bound));
+        for (const ReactCheck &c : rec.checks)
+            f.write((const char *) &c.error, sizeof(c.error));
+    }
+
+#ifdef PROFILE
+    uint32_t n_phases = N_PHASES;
+    f.write((const char *) &n_phases, sizeof(n_phases));
+    f.write((const char *) rec.prof.seconds, sizeof(rec.prof.seconds));
+    f.write((const char *) rec.prof.calls, sizeof(rec.prof.calls));
+    f.write((const char *) rec.prof.bytes, sizeof(rec.prof.bytes));
+#endif
+}
@@ -0,0 +1,89 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include "Retina.h"
+#include "Profile.h"
+
+// Log formats
+#define LOG_TSV 0 // Legacy per-row text
+#define LOG_BIN 1 // Columnar binary
+#define LOG_BINZ 2 // Columnar binary, zlib-compressed blocks
+
+#define LOG_SLOTS 16 // Generations buffered ahead of the writer
+
+// How well the surrogate predicted the children of a generation
+struct ModelStats
+{
+    int n; // Children it was checked against; 0 if none
+    double mae, corr;
+};
+
+// A fast react of one genome against the fixed-T Euler it approximates
+struct ReactCheck
+{
+    double bound; // Of its ganglion input, from Retina::react
+    double error; // Largest firing rate difference, measured
+};
+
+/*
+ * Per-generation stats are copied into a single-producer single-consumer
+ * ring and written by a background thread, so that formatting, I/O and
+ * progress printing stay off the evaluation thread.
+ *
+ * Binary layout (native endianness):
+ *   header: "RLOG" | u32 version | u32 tid | u32 n_fields | u32 flags
+ *   block:  i32 gen | i32 n | u64 raw_bytes | u64 stored_bytes | payload
+ *   payload (columns): f64 fit_cost[n] | i32 n_synapses[n] | f64 i2e[n]
+ *   if flags & 1 the payload is zlib-compressed, unless stored_bytes ==
+ *   raw_bytes, in which case that block is stored raw
+ *   if flags & 4 (run with a surrogate), the block is followed by
+ *   i32 model_n | f64 model_mae | f64 model_corr
+ *   if flags & 8 (run with react_check), then by the genomes checked:
+ *   i32 k | f64 bound[k] | f64 error[k]
+ *   if flags & 2 (built with PROFILE), then by
+ *   u32 n_phases | f64 seconds[n_phases] | i64 calls[..] | i64 bytes[..]
+ * The TSV layout ends each generation of a surrogate run with a
+ * "#model" row of the same three, and of a react_check run with a
+ * "#react" row of bound and error per check. Convert with `retina_io.py log2tsv`.
+ */
+class Logger
+{
+public:
+    Logger(const std::string &fname, const int tid, const int format,
+           const bool model = false, const bool react = false);
+    ~Logger();
+    void push(const int gen, const Genome *g, const int n,
+              const ModelStats &model = ModelStats(),
+              const std::vector<ReactCheck> &checks = {});
+    void close();
+
+private:
+    struct Record
+    {
+        int gen;
+        std::vector<double> fit_cost, i2e;
+        std::vector<int> n_synapses;
+        ModelStats model;
+        std::vector<ReactCheck> checks;
+        PhaseStats prof; // Of the evaluation thread, since the last push
+    };
+
+    int tid, format;
+    bool model; // Records carry ModelStats
+    bool react; // Records carry ReactChecks
+    Record buf[LOG_SLOTS];
+    std::atomic<unsigned> head, tail;
+    std::atomic<bool> done;
+    std::ofstream f;
+    std::thread writer;
+
+    void drain();
+    void write_block(const Record &rec);
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include <cmath>
+#include <algorithm>
+#include "Niche.h"
+#include "tool.h"
+
+#define LEAF 8 // Nodes this small are scanned
+#define CANDIDATES 8 // Per neighbour asked for, before the exact ranking
+
+GenomeIndex::GenomeIndex() : proj(GENOME_DIMS, NICHE_PROJ)
+{
+    for (int i = 0; i < GENOME_DIMS; i++)
+        for (int j = 0; j < NICHE_PROJ; j++)
+            proj(i, j) = normal(0, 1 / sqrt((double) NICHE_PROJ));
+}
+
+void GenomeIndex::build(const Genome *g, const int n)
+{
+    v.resize(n, GENOME_DIMS);
+    Eigen::Matrix<double, 1, GENOME_DIMS> f;
+    for (int i = 0; i < n; i++)
+    {
+        g[i].embed(f.data());
+        v.row(i) = f;
+    }
+    p.noalias() = v * proj;
+
+    order.resize(n);
+    for (int i = 0; i < n; i++) order[i] = i;
+    split.assign(n, 0);
+    build(0, n);
+}
+
+// Splits on the widest projected dimension at its median
+void GenomeIndex::build(const int lo, const int hi)
+{
+    if (hi - lo <= LEAF) return;
+
+    int d = 0;
+    double widest = -1;
+    for (int k = 0; k < NICHE_PROJ; k++)
+    {
+        double a = p(order[lo], k), b = a;
+        for (int i = lo + 1; i < hi; i++)
+        {
+            a = std::min(a, p(order[i], k));
+            b = std::max(b, p(order[i], k));
+        }
+        if (b - a > widest) { widest = b - a; d = k; }
+    }
+
+    int mid = (lo + hi) / 2;
+    std::nth_element(order.begin() + lo, order.begin() + mid,
+                     order.begin() + hi, [&](const int a, const int b)
+                     { return p(a, d) < p(b, d); });
+    split[mid] = d;
+    build(lo, mid);
+    build(mid + 1, hi);
+}
+
+// The c nearest to genome i in the projection, as a max-heap
+void GenomeIndex::search(const int lo, const int hi, const int i,
+                         const int c,
+                         std::vector<std::pair<double, int> > &heap) const
+{
+    auto offer = [&](const int j)
+    {
+        if (j == i) return;
+        double d = (p.row(j) - p.row(i)).squaredNorm();
+        if ((int) heap.size() < c) heap.emplace_back(d, j);
+        else if (d < heap.front().first)
+        {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = std::make_pair(d, j);
+        }
+        else return;
+        std::push_heap(heap.begin(), heap.end());
+    };
+
+    if (hi - lo <= LEAF)
+    {
+        for (int k = lo; k < hi; k++) offer(order[k]);
+        return;
+    }
+
+    int mid = (lo + hi) / 2, d = split[mid];
+    double gap = p(i, d) - p(order[mid], d);
+    offer(order[mid]);
+
+    // The near side first; the far one only if it can still hold closer
+    if (gap < 0) search(lo, mid, i, c, heap);
+    else search(mid + 1, hi, i, c, heap);
+    if ((int) heap.size() < c || gap * gap < heap.front().first)
+    {
+        if (gap < 0) search(mid + 1, hi, i, c, heap);
+        else search(lo, mid, i, c, heap);
+    }
+}
+
+/*
+ * Up to k other genomes nearest to genome i, nearest first, with their
+ * distances. Candidates come from the projection, so a neighbour the
+ * projection pulls far away can be missed.
+ */
+int GenomeIndex::knn(const int i, const int k, int *idx, double *dist) const
+{
+    std::vector<std::pair<double, int> > heap;
+    heap.reserve(CANDIDATES * k);
+    search(0, v.rows(), i, CANDIDATES * k, heap);
+
+    for (auto &c : heap) c.first = (v.row(c.second) - v.row(i)).norm();
+    int m = std::min(k, (int) heap.size());
+    std::partial_sort(heap.begin(), heap.begin() + m, heap.end());
+
+    for (int j = 0; j < m; j++)
+    {
+        idx[j] = heap[j].second;
+        dist[j] = heap[j].first;
+    }
+    return m;
+}
@@ -0,0 +1,37 @@
+#ifndef NICHE_H
+#define NICHE_H
+
+#include <vector>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+#include "Retina.h"
+using Eigen::MatrixXd;
+
+#define NICHE_PROJ 8 // Dimensions the k-d tree splits on
+
+/*
+ * Nearest neighbours among genomes, for niching, as the vectors of
+ * Genome::embed. A k-d tree over a fixed random projection of them
+ * proposes candidates, which are ranked by their exact distance, so a
+ * query is O(log n) where a scan of the population would be O(n).
+ */
+class GenomeIndex
+{
+public:
+    GenomeIndex();
+    void build(const Genome *g, const int n);
+    int knn(const int i, const int k, int *idx, double *dist) const;
+
+private:
+    MatrixXd v; // Row per genome
+    MatrixXd p; // Its projection
+    MatrixXd proj;
+    std::vector<int> order; // Of the k-d tree; node [lo, hi) splits at mid
+    std::vector<int> split; // Dimension of the node of each mid
+
+    void build(const int lo, const int hi);
+    void search(const int lo, const int hi, const int i, const int c,
+                std::vector<std::pair<double, int> > &heap) const;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include "Pareto.h"
+#include "tool.h"
+
+#define N_OBJECTIVES 3
+
+typedef std::array<double, N_OBJECTIVES> Objectives;
+
+static Objectives objectives(const Genome &g)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    if (g.screened) return {inf, inf, inf}; // Never evaluated
+
+    double cells = 0;
+    for (int i = 0; i < g.n_types; i++) cells += g.n_cell[i];
+
+    double fit = (g.fit_cost != g.fit_cost)? inf : g.fit_cost; // NaN is worst
+    Objectives f = {fit, (double) g.n_synapses, cells};
+
+    for (int k = 0; k < N_OBJECTIVES; k++)
+        if (W_COST(k) == 0) f[k] = 0; // Ignored
+    return f;
+}
+
+// a no worse than b in every objective and better in one
+static bool dominates(const Objectives &a, const Objectives &b)
+{
+    bool better = false;
+    for (int k = 0; k < N_OBJECTIVES; k++)
+    {
+        if (a[k] > b[k]) return false;
+        if (a[k] < b[k]) better = true;
+    }
+    return better;
+}
+
+void pareto_rank(Genome *g, const int n)
+{
+    std::vector<Objectives> f(n);
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++)
+    {
+        f[i] = objectives(g[i]);
+        order[i] = i;
+    }
+
+    // Lexicographic order: no genome is dominated by a later one
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b) { return f[a] < f[b]; });
+
+    // Each genome goes to the first front with no member dominating it.
+    // Being dominated in front k implies it in every front before k, so
+    // the fronts can be bisected; members are checked newest first.
+    std::vector<std::vector<int>> fronts;
+    for (int s : order)
+    {
+        int lo = 0, hi = fronts.size();
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            const std::vector<int> &front = fronts[mid];
+            bool dominated = false;
+            for (auto t = front.rbegin(); t != front.rend() && !dominated; ++t)
+                dominated = dominates(f[*t], f[s]);
+
+            if (dominated) lo = mid + 1;
+            else hi = mid;
+        }
+
+        if (lo == (int) fronts.size()) fronts.emplace_back();
+        fronts[lo].push_back(s);
+        g[s].front = lo;
+        g[s].crowding = 0;
+    }
+
+    // Crowding distance: the normalized gap around each genome, per
+    // objective, with the extremes of a front kept at infinity
+    for (std::vector<int> &front : fronts)
+    {
+        for (int k = 0; k < N_OBJECTIVES; k++)
+        {
+            if (W_COST(k) == 0) continue;
+
+            // Ties in index order, so that which of them is an extreme
+            // and whose neighbours they are does not depend on the sort
+            std::sort(front.begin(), front.end(), [&](int a, int b)
+                      { return f[a][k] < f[b][k] ||
+                               (f[a][k] == f[b][k] && a < b); });
+
+            const double inf = std::numeric_limits<double>::infinity();
+            double lo = f[front.front()][k], hi = lo; // Finite range
+            for (int s : front) if (f[s][k] != inf) hi = f[s][k];
+            g[front.front()].crowding = g[front.back()].crowding = inf;
+            if (hi == lo) continue;
+
+            for (size_t m = 1; m + 1 < front.size(); m++)
+            {
+                // Between two infinite costs the gap is inf - inf, a NaN
+                // that would leave pareto_better() no strict weak order
+                double gap = f[front[m + 1]][k] - f[front[m - 1]][k];
+                g[front[m]].crowding += !(gap < inf)? inf :
+                                        W_COST(k) * gap / (hi - lo);
+            }
+        }
+    }
+}
+
+// Lower front first, then the less crowded
+bool pareto_better(const Genome &a, const Genome &b)
+{
+    if (a.front != b.front) return a.front < b.front;
+    return a.crowding > b.crowding;
+}
+
+int pareto_comparator(const void *r1, const void *r2)
+{
+    const Genome *r_a = (Genome *) r1;
+    const Genome *r_b = (Genome *) r2;
+
+    if (pareto_better(*r_a, *r_b)) return -1;
+    if (pareto_better(*r_b, *r_a)) return 1;
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef PARETO_H
+#define PARETO_H
+
+#include "Retina.h"
+
+/*
+ * Multi-objective ranking of a population on (fit_cost, n_synapses,
+ * total cells), all minimized; objectives with a zero weight in W_COST
+ * are left out. Genomes get their non-dominated front, by an efficient
+ * non-dominated sort with binary search over the fronts (ENS-BS), and
+ * their W_COST-weighted crowding distance within it, as in NSGA-II.
+ */
+void pareto_rank(Genome *g, const int n);
+int pareto_comparator(const void *r1, const void *r2);
+bool pareto_better(const Genome &a, const Genome &b);
+
+#endif
@@ -0,0 +1,138 @@
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "Profile.h"
+
+extern "C" void *__libc_malloc(size_t size);
+
+thread_local PhaseStats PROF = {};
+
+const char *PHASE_NAMES[N_PHASES] = {
+    "organize", "init", "react", "nn_train", "nn_test", "rank",
+    "select", "crossover", "mutate", "log", "niche",
+    "react_layer0", "react_layer1", "react_layer2", "react_layer3",
+    "react_layer4", "react_layer5", "react_layer6"
+};
+
+// Count heap allocations per thread, including Eigen's, in profile and
+// benchmark builds only. Not in the Python module, where malloc is the
+// interpreter's
+#if (defined(PROFILE) || defined(ALLOC_COUNT)) && !defined(RETINA_MODULE)
+thread_local long ALLOCS = 0, ALLOC_BYTES = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    ALLOCS++;
+    ALLOC_BYTES += size;
+    return __libc_malloc(size);
+}
+#endif
+
+void PhaseStats::reset()
+{
+    std::memset(this, 0, sizeof(PhaseStats));
+}
+
+void PhaseStats::add(const PhaseStats &o)
+{
+    for (int p = 0; p < N_PHASES; p++)
+    {
+        seconds[p] += o.seconds[p];
+        calls[p] += o.calls[p];
+        bytes[p] += o.bytes[p];
+    }
+}
+
+struct TraceEvent
+{
+    int p;
+    long lane; // OS thread that ran the phase
+    double start, dur; // In microseconds
+};
+
+static bool TRACE = false;
+static thread_local std::vector<TraceEvent> EVENTS; // Workers' included
+static thread_local const long LANE = syscall(SYS_gettid);
+static const std::chrono::steady_clock::time_point EPOCH =
+    std::chrono::steady_clock::now();
+
+void trace_enable(const bool on)
+{
+    TRACE = on;
+}
+
+bool trace_enabled()
+{
+    return TRACE;
+}
+
+// Chrome trace-event JSON of this thread's phases (chrome://tracing), with
+// those of its OpenMP workers: a process per GA thread, and a row per OS
+// thread within it. Only profile builds record phases, so other builds
+// write nothing.
+void trace_write(const std::string &fname, const int tid)
+{
+    if (!TRACE || EVENTS.empty()) return;
+
+    std::ofstream f(fname);
+    f << "{\"traceEvents\": [\n";
+    for (size_t i = 0; i < EVENTS.size(); i++)
+    {
+        f << (i? ",\n" : "") << "{\"name\": \"" << PHASE_NAMES[EVENTS[i].p]
+          << "\", \"ph\": \"X\", \"pid\": " << tid
+          << ", \"tid\": " << EVENTS[i].lane
+          << ", \"ts\": " << EVENTS[i].start
+          << ", \"dur\": " << EVENTS[i].dur << "}";
+    }
+    f << "\n]}\n";
+    f.close();
+
+    EVENTS.clear();
+}
+
+#ifdef PROFILE
+
+ScopedPhase::ScopedPhase(const int p_)
+    : p(p_), b0(ALLOC_BYTES), t0(std::chrono::steady_clock::now()) {}
+
+ScopedPhase::~ScopedPhase()
+{
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+    double s = std::chrono::duration<double>(t1 - t0).count();
+
+    PROF.seconds[p] += s;
+    PROF.calls[p]++;
+    PROF.bytes[p] += ALLOC_BYTES - b0;
+
+    // Layer updates are too fine-grained for a timeline
+    if (TRACE && p < PH_LAYER)
+    {
+        double start = std::chrono::duration<double, std::micro>(t0 - EPOCH).count();
+        EVENTS.push_back({p, LANE, start, s * 1e6});
+    }
+}
+
+ProfileOwner profile_owner()
+{
+    return {&PROF, &EVENTS};
+}
+
+// This thread's phases and trace events moved into another thread's; an
+// OpenMP worker's into the thread it worked for, which is past the loop's
+// barrier by then. Their seconds are summed over threads.
+void profile_merge(const ProfileOwner &into)
+{
+    if (into.prof == &PROF) return; // The region ran on its own thread
+
+    #pragma omp critical (profile_merge)
+    {
+        into.prof->add(PROF);
+        into.events->insert(into.events->end(), EVENTS.begin(), EVENTS.end());
+    }
+    PROF.reset();
+    EVENTS.clear();
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+/*
+ * Per-thread phase timers, call counts and heap bytes. Build with
+ * -DPROFILE (make profile) to enable them; otherwise PROFILE_SCOPE
+ * compiles to nothing. The malloc hook behind ALLOCS and ALLOC_BYTES is
+ * only in profile builds and in Benchmark (-DALLOC_COUNT), so release
+ * binaries allocate through the C library directly.
+ */
+enum Phase
+{
+    PH_ORGANIZE, PH_INIT, PH_REACT, PH_NN_TRAIN, PH_NN_TEST, PH_RANK,
+    PH_SELECT, PH_CROSSOVER, PH_MUTATE, PH_LOG, PH_NICHE,
+    PH_LAYER, // Retina::react layer i is PH_LAYER + i
+    N_PHASES = PH_LAYER + 7 // MAX_TYPES
+};
+
+struct PhaseStats
+{
+    double seconds[N_PHASES];
+    long calls[N_PHASES];
+    long bytes[N_PHASES];
+
+    void reset();
+    void add(const PhaseStats &o);
+};
+
+extern thread_local PhaseStats PROF;
+extern thread_local long ALLOCS, ALLOC_BYTES; // Of this thread, via malloc
+extern const char *PHASE_NAMES[N_PHASES];
+
+struct TraceEvent;
+
+// The thread an OpenMP region's workers report their phases to
+struct ProfileOwner
+{
+    PhaseStats *prof;
+    std::vector<TraceEvent> *events;
+};
+
+void trace_enable(const bool on);
+bool trace_enabled();
+void trace_write(const std::string &fname, const int tid);
+
+#ifdef PROFILE
+
+class ScopedPhase
+{
+public:
+    ScopedPhase(const int p);
+    ~ScopedPhase();
+
+private:
+    int p;
+    long b0;
+    std::chrono::steady_clock::time_point t0;
+};
+
+#define PROFILE_CAT(a, b) a##b
+#define PROFILE_NAME(l) PROFILE_CAT(prof_scope_, l)
+#define PROFILE_SCOPE(p) ScopedPhase PROFILE_NAME(__LINE__)(p)
+
+ProfileOwner profile_owner();
+void profile_merge(const ProfileOwner &into);
+
+// Around an OpenMP region whose threads time phases: PROFILE_OWNER before
+// it, and PROFILE_MERGE inside it after the loop, so that the workers'
+// phases are summed into, and their trace events moved to, the thread
+// that started the region
+#define PROFILE_OWNER ProfileOwner prof_owner = profile_owner()
+#define PROFILE_MERGE profile_merge(prof_owner)
+
+#else
+
+#define PROFILE_SCOPE(p)
+#define PROFILE_OWNER
+#define PROFILE_MERGE
+
+#endif
+
+#endif
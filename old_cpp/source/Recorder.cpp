@@ -0,0 +1,133 @@
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include "Recorder.h"
+#include "tool.h"
+
+#define EVENT_HEADER 20
+
+Recorder RECORDER;
+
+// This thread's ring, and the open() it belongs to
+static thread_local void *RING = nullptr;
+static thread_local unsigned RING_EPOCH = 0;
+
+Recorder::Recorder() : epoch(0), done(false) {}
+
+Recorder::~Recorder()
+{
+    close();
+}
+
+bool Recorder::open(const std::string &fname, const int every)
+{
+    close();
+
+    f.open(fname, std::ios::binary);
+    if (!f.is_open()) return false;
+
+    uint32_t hdr[3] = {RECORD_VERSION, (uint32_t) T, (uint32_t) every};
+    f.write("RREC", 4);
+    f.write((const char *) hdr, sizeof(hdr));
+
+    epoch++;
+    done.store(false, std::memory_order_release);
+    writer = std::thread([this]() { drain(); });
+    return true;
+}
+
+// Every event pushed before this is written
+void Recorder::close()
+{
+    if (!writer.joinable()) return;
+
+    done.store(true, std::memory_order_release);
+    writer.join();
+    f.close();
+
+    std::lock_guard<std::mutex> guard(m);
+    rings.clear();
+    epoch++; // Threads take new rings at their next event
+}
+
+Recorder::Ring *Recorder::ring()
+{
+    if (RING && RING_EPOCH == epoch) return (Ring *) RING;
+
+    Ring *r = new Ring();
+    r->buf.resize(RECORD_RING);
+    r->head = r->tail = 0;
+
+    std::lock_guard<std::mutex> guard(m);
+    rings.emplace_back(r);
+    RING = r;
+    RING_EPOCH = epoch;
+    return r;
+}
+
+// Copies n bytes into or out of the ring at byte pos, wrapping around
+static void wrap_copy(char *buf, const uint64_t pos, char *p, const size_t n,
+                      const bool in)
+{
+    size_t at = pos & (RECORD_RING - 1);
+    size_t first = std::min(n, (size_t) RECORD_RING - at);
+    if (in)
+    {
+        memcpy(buf + at, p, first);
+        memcpy(buf, p + first, n - first);
+    }
+    else
+    {
+        memcpy(p, buf + at, first);
+        memcpy(p + first, buf, n - first);
+    }
+}
+
+void Recorder::event(const int kind, const int layer, const uint32_t source,
+                     const int row, const int t, const void *data,
+                     const int n)
+{
+    Ring *r = ring();
+    uint32_t hdr[5] = {(uint32_t) (kind | layer << 16), source,
+                       (uint32_t) row, (uint32_t) t, (uint32_t) n};
+    uint64_t size = EVENT_HEADER + 4 * (uint64_t) n;
+
+    uint64_t h = r->head.load(std::memory_order_relaxed);
+    while (h + size - r->tail.load(std::memory_order_acquire) > RECORD_RING)
+        std::this_thread::yield(); // Back-pressure
+
+    wrap_copy(r->buf.data(), h, (char *) hdr, EVENT_HEADER, true);
+    wrap_copy(r->buf.data(), h + EVENT_HEADER, (char *) data, 4 * n, true);
+    r->head.store(h + size, std::memory_order_release);
+}
+
+// Writes the events published to r so far; false if there were none
+bool Recorder::drain(Ring &r)
+{
+    uint64_t t = r.tail.load(std::memory_order_relaxed);
+    uint64_t h = r.head.load(std::memory_order_acquire);
+    if (t == h) return false;
+
+    std::vector<char> out(h - t);
+    wrap_copy(r.buf.data(), t, out.data(), h - t, false);
+    f.write(out.data(), out.size());
+    r.tail.store(h, std::memory_order_release);
+    return true;
+}
+
+void Recorder::drain()
+{
+    while (true)
+    {
+        bool finished = done.load(std::memory_order_acquire);
+
+        bool any = false;
+        {
+            std::lock_guard<std::mutex> guard(m);
+            for (auto &r : rings) any |= drain(*r);
+        }
+
+        if (finished && !any) break;
+        if (!any) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
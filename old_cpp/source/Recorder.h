@@ -0,0 +1,75 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <fstream>
+#include <cstdint>
+
+#define RECORD_VERSION 1
+#define RECORD_RING (1 << 22) // Bytes per thread; a power of 2
+
+// Event kinds
+#define EV_SPIKES 1
+#define EV_STATE 2
+
+// What Retina::react_fixed() records of one genome
+struct Probe
+{
+    uint32_t source; // Written with its events
+    const int *rows; // Dataset row of each row reacted
+    int every; // Steps between layer states; 0 is spikes only
+};
+
+/*
+ * Spike rasters and layer states of chosen genomes on chosen rows, for
+ * analysing their dynamics. react_fixed() given a Probe appends events
+ * to its thread's ring, allocated on the thread's first event, and a
+ * background thread moves whole events from the rings to the file. A
+ * full ring holds its producer back, as the Logger's does. Without a
+ * Probe, react_fixed() pays a predictable branch per spike and per step.
+ *
+ * Layout (native endianness):
+ *   header: "RREC" | u32 version | u32 T | u32 every
+ *   event:  u16 kind | u16 layer | u32 source | u32 row | u32 t | u32 n,
+ *           then for EV_SPIKES the n u32 ganglion cells that fired at t,
+ *           for EV_STATE the n f32 potentials of the layer's cells after t
+ * source is tid * 65536 + rank. See retina_io.read_record.
+ */
+class Recorder
+{
+public:
+    Recorder();
+    ~Recorder();
+    bool open(const std::string &fname, const int every);
+    void close();
+    bool is_open() const { return writer.joinable(); }
+    void event(const int kind, const int layer, const uint32_t source,
+               const int row, const int t, const void *data, const int n);
+
+private:
+    struct Ring
+    {
+        std::vector<char> buf;
+        std::atomic<uint64_t> head, tail; // Bytes ever written, read
+    };
+
+    std::vector<std::unique_ptr<Ring> > rings;
+    std::mutex m; // Of rings
+    unsigned epoch; // Of the current open()
+    std::atomic<bool> done;
+    std::ofstream f;
+    std::thread writer;
+
+    Ring *ring();
+    void drain();
+    bool drain(Ring &r);
+};
+
+extern Recorder RECORDER;
+
+#endif
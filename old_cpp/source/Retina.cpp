@@ -1,18 +1,276 @@
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <map>
 #define EIGEN_USE_MKL_ALL
 #include <Eigen/Dense>
 #include "Retina.h"
 #include "tool.h"
+#include "Profile.h"
+#include "Recorder.h"
+#include "Arena.h"
 using Eigen::MatrixXd;
 
+Retina::Retina() : n(0), th(0) {}
+
+// Weight from i to j, empty if there is no such edge; dense edges only
+Eigen::Map<const MatrixXd> Retina::W(const int i, const int j) const
+{
+    const Edge &e = edge[i][j];
+    return Eigen::Map<const MatrixXd>(e.w.data(), e.ni, e.nj);
+}
+
+// out = s * weight from i to j, or out += with add; dense or sparse
+void Retina::project(const Eigen::Ref<const MatrixXd> &s, const int i,
+                     const int j, Eigen::Ref<MatrixXd> out,
+                     const bool add) const
+{
+    const Edge &e = edge[i][j];
+    if (e.sparse)
+    {
+        if (add) out.noalias() += s * e.sw;
+        else out.noalias() = s * e.sw;
+    }
+    else if (add) out.noalias() += s * W(i, j);
+    else out.noalias() = s * W(i, j);
+}
+
+// Weight from i to j into dst, expanded if it is kept sparse
+void Retina::dense(const int i, const int j, Eigen::Ref<MatrixXd> dst) const
+{
+    const Edge &e = edge[i][j];
+    if (e.sparse) dst = e.sw.toDense();
+    else dst = W(i, j);
+}
+
+// Largest absolute column sum of the weight from i to j: how far a change
+// of at most d in every cell of i can move any cell of j's input
+double Retina::gain(const int i, const int j) const
+{
+    const Edge &e = edge[i][j];
+    if (e.ni == 0 || e.nj == 0) return 0;
+    if (!e.sparse) return W(i, j).cwiseAbs().colwise().sum().maxCoeff();
+
+    double m = 0;
+    for (int c = 0; c < e.sw.outerSize(); c++)
+    {
+        double sum = 0;
+        for (Eigen::SparseMatrix<double>::InnerIterator it(e.sw, c); it; ++it)
+            sum += fabs(it.value());
+        m = std::max(m, sum);
+    }
+    return m;
+}
+
+MatrixXd Retina::dense(const int i, const int j) const
+{
+    MatrixXd w(edge[i][j].ni, edge[i][j].nj);
+    dense(i, j, w);
+    return w;
+}
+
+/*
+ * Moves the distance range of e to [start, end], adding and dropping the
+ * synapses that cross a bound, with pi and pj the cell positions e was
+ * built from. Only a distance between an old and a new bound can change
+ * side, so each p checks the few q around those bounds.
+ */
+void Retina::move_range(Edge &e, const double *pi, const double *pj,
+                        const double start, const double end,
+                        const double weight)
+{
+    Eigen::Map<MatrixXd> wij(e.w.data(), e.ni, e.nj);
+    double cj = ((double) e.nj - 1) / 2;
+    double moved[2][2] = {{std::min(start, e.start), std::max(start, e.start)},
+                          {std::min(end, e.end), std::max(end, e.end)}};
+
+    for (int p = 0; p < e.ni; p++)
+    {
+        for (const double *b : moved)
+        {
+            if (b[0] == b[1]) continue; // This bound did not move
+
+            for (int sgn = -1; sgn <= 1; sgn += 2)
+            { // pi[p] - pj[q] = sgn * d, d in [b[0], b[1]]
+                double q0 = (pi[p] - sgn * b[0]) / e.intvl_j + cj;
+                double q1 = (pi[p] - sgn * b[1]) / e.intvl_j + cj;
+                int lo = std::max(0, (int) std::floor(std::min(q0, q1)) - 1);
+                int hi = std::min(e.nj - 1,
+                                  (int) std::ceil(std::max(q0, q1)) + 1);
+
+                for (int q = lo; q <= hi; q++)
+                {
+                    double d = fabs(pi[p] - pj[q]); // As in init()
+                    bool in = d >= start && d <= end;
+                    if (in == (wij(p, q) != 0)) continue;
+
+                    wij(p, q) = in? weight : 0;
+                    e.n_synapses += in? 1 : -1;
+                }
+            }
+        }
+    }
+    e.start = start;
+    e.end = end;
+}
+
+// Deterministic jitter in [-0.5, 0.5) of cell p of n, coordinate c
+static double jitter(const int n, const int p, const int c)
+{
+    uint64_t z = ((uint64_t) n << 32 | (uint32_t) p) * 2 + c;
+    z += 0x9e3779b97f4a7c15; // splitmix64
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    z ^= z >> 31;
+    return (z >> 11) * 0x1.0p-53 - 0.5;
+}
+
+/*
+ * x, y of the n cells of a 2-D layer, centred on 0 in the unit square:
+ * row-major on a square grid of k = ceil(sqrt(n)) columns, so that the
+ * receptors take the stimulus columns as a flattened image. MOSAIC 1
+ * shifts odd rows by half a spacing and packs the rows into a hexagonal
+ * grid; MOSAIC 2 jitters each cell by up to a quarter spacing.
+ */
+static void place_2d(double *pos, const int n)
+{
+    int k = std::ceil(std::sqrt((double) n));
+    double a = 1.0 / k;
+
+    for (int p = 0; p < n; p++)
+    {
+        int cx = p % k, cy = p / k;
+        double x = a * (cx - (k - 1) / 2.0), y = a * (cy - (k - 1) / 2.0);
+
+        if (MOSAIC == 1)
+        {
+            if (cy & 1) x += a / 2;
+            y *= std::sqrt(3.0) / 2;
+        }
+        else
+        {
+            x += a / 2 * jitter(n, p, 0);
+            y += a / 2 * jitter(n, p, 1);
+        }
+        pos[2 * p] = x;
+        pos[2 * p + 1] = y;
+    }
+}
+
+/*
+ * Synapses of a 2-D edge at Euclidean distances in [e.start, e.end]: into
+ * e.sw alone if they are few, else into e.w. j's cells are binned in a
+ * uniform grid of squares no smaller than e.end, so each cell of i only
+ * examines the 3x3 squares around it rather than all of j.
+ */
+void Retina::connect_2d(Edge &e, const double *pi, const double *pj,
+                        const double weight)
+{
+    double x0 = pj[0], x1 = pj[0], y0 = pj[1], y1 = pj[1];
+    for (int q = 1; q < e.nj; q++)
+    {
+        x0 = std::min(x0, pj[2 * q]); x1 = std::max(x1, pj[2 * q]);
+        y0 = std::min(y0, pj[2 * q + 1]); y1 = std::max(y1, pj[2 * q + 1]);
+    }
+
+    // At most about one square per cell of j
+    double span = std::max(x1 - x0, y1 - y0);
+    double side = std::max({e.end, span / std::ceil(std::sqrt(e.nj)), 1e-9});
+    int gx = (x1 - x0) / side + 1, gy = (y1 - y0) / side + 1;
+
+    // Cells of j by square, as a counting sort
+    std::vector<int> first(gx * gy + 1, 0), cell(e.nj), sq(e.nj);
+    for (int q = 0; q < e.nj; q++)
+    {
+        int bx = (pj[2 * q] - x0) / side, by = (pj[2 * q + 1] - y0) / side;
+        sq[q] = by * gx + bx;
+        first[sq[q] + 1]++;
+    }
+    for (int b = 0; b < gx * gy; b++) first[b + 1] += first[b];
+    for (int q = 0; q < e.nj; q++) cell[first[sq[q]]++] = q;
+    for (int b = gx * gy; b > 0; b--) first[b] = first[b - 1];
+    first[0] = 0;
+
+    std::vector<Eigen::Triplet<double>> syn;
+    for (int p = 0; p < e.ni; p++)
+    {
+        int bx = std::floor((pi[2 * p] - x0) / side);
+        int by = std::floor((pi[2 * p + 1] - y0) / side);
+
+        for (int sy = std::max(0, by - 1); sy <= std::min(gy - 1, by + 1); sy++)
+        {
+            for (int sx = std::max(0, bx - 1); sx <= std::min(gx - 1, bx + 1); sx++)
+            {
+                for (int k = first[sy * gx + sx]; k < first[sy * gx + sx + 1]; k++)
+                {
+                    int q = cell[k];
+                    double dx = pi[2 * p] - pj[2 * q];
+                    double dy = pi[2 * p + 1] - pj[2 * q + 1];
+                    double d = std::sqrt(dx * dx + dy * dy);
+                    if (d < e.start || d > e.end) continue;
+
+                    syn.emplace_back(p, q, weight);
+                }
+            }
+        }
+    }
+
+    e.n_synapses = syn.size();
+
+    // Dense GEMMs win unless few pairs are connected. The dense form of a
+    // sparse edge is never held, which at thousands of cells per layer
+    // would take most of the memory of a 2-D run.
+    e.sparse = 8L * e.n_synapses < (long) e.ni * e.nj;
+    if (e.sparse)
+    {
+        std::vector<double>().swap(e.w);
+        e.sw.resize(e.ni, e.nj);
+        e.sw.setFromTriplets(syn.begin(), syn.end());
+        return;
+    }
+
+    e.sw = Eigen::SparseMatrix<double>();
+    e.w.assign((size_t) e.ni * e.nj, 0.0);
+    Eigen::Map<MatrixXd> wij(e.w.data(), e.ni, e.nj);
+    for (const Eigen::Triplet<double> &t : syn) wij(t.row(), t.col()) = weight;
+}
+
+/*
+ * Builds the weights of g. Edges whose two layers are not dirty in g are
+ * kept as they are; a dirty edge on the same 1-D lattice only gets the new
+ * weight and the synapses that crossed a bound of its range. 2-D layers
+ * (MOSAIC) are connected through a cell list, and kept only sparse when
+ * few of their pairs are.
+ * Clears g.dirty.
+ */
 void Retina::init(Genome &g)
 {
+    unsigned dirty = (g.n_types == n)? g.dirty : ALL_LAYERS;
     n = g.n_types;
     th = g.th;
 
     for (int i = 0; i < n; i++) n_cell[i] = g.n_cell[i];
 
+    // Cell positions, centred on 0. Distances are taken from these alone
+    // so that move_range() sees bit-identical ones, contraction or not
+    ArenaScope scope(ARENA);
+    double *pos[MAX_TYPES];
+    for (int i = 0; i < n && n > 2; i++)
+    {
+        if (MOSAIC)
+        { // x, y pairs
+            pos[i] = ARENA.alloc(2 * n_cell[i]);
+            place_2d(pos[i], n_cell[i]);
+            continue;
+        }
+
+        pos[i] = ARENA.alloc(n_cell[i]);
+        for (int p = 0; p < n_cell[i]; p++)
+            pos[i][p] = g.intvl[i] * (p - ((double) n_cell[i] - 1) / 2);
+    }
+
     // Make the weight from i to j
     for (int i = 0; i < n - 1; i++)
     { // ganglion cells do not project
@@ -33,15 +291,63 @@ void Retina::init(Genome &g)
             int ni = n_cell[i];
             int nj = n_cell[j];
 
-            if (ni == 0 || nj == 0) continue;
+            Edge &e = edge[i][j];
+            if (ni == 0 || nj == 0)
+            {
+                e.ni = e.nj = 0;
+                e.sparse = false;
+                continue;
+            }
 
-            w[i][j] = MatrixXd::Zero(ni, nj); // Take the ref
+            if (!(dirty >> i & 1) && !(dirty >> j & 1) && e.ni == ni &&
+                e.nj == nj)
+            {
+                g.n_synapses += e.n_synapses;
+                continue;
+            }
 
             // Calculate affinity between 0 and 1
             int aff = (cos(fabs(g.axon[i] - g.dendrite[j])) < 0)? -1 : 1;
             // aff = (aff > 0)? aff : 0;
             // if (aff == 0) continue;
 
+            double start = (g.beta[i] < 0)? 0 : g.beta[i];
+            double end = start + g.phi[i];
+            if (end > 1) end = 1;
+            double weight = aff / (g.n_cell[i] * 2 * (end - start));
+
+            if (!MOSAIC && e.ni == ni && e.nj == nj && e.aff == aff &&
+                e.intvl_i == g.intvl[i] && e.intvl_j == g.intvl[j])
+            { // Same lattice
+                Eigen::Map<MatrixXd> wij(e.w.data(), ni, nj);
+                if (end - start != e.end - e.start)
+                    wij.array() = (wij.array() != 0).select(weight, wij.array());
+                move_range(e, pos[i], pos[j], start, end, weight);
+                g.n_synapses += e.n_synapses;
+                continue;
+            }
+
+            e.ni = ni;
+            e.nj = nj;
+            e.aff = aff;
+            e.intvl_i = g.intvl[i];
+            e.intvl_j = g.intvl[j];
+            e.start = start;
+            e.end = end;
+            e.n_synapses = 0;
+            e.sparse = false;
+
+            if (MOSAIC)
+            {
+                connect_2d(e, pos[i], pos[j], weight);
+                g.n_synapses += e.n_synapses;
+                continue;
+            }
+
+            e.w.resize(ni * nj); // Keeps its capacity when shrinking
+            Eigen::Map<MatrixXd> wij(e.w.data(), ni, nj);
+            wij.setZero();
+
             // double maxi = INT_MIN;
             // double mini = INT_MAX;
 
@@ -50,14 +356,10 @@ void Retina::init(Genome &g)
             {
                 for (int q = 0; q < nj; q++)
                 {
-                    double d = fabs(g.intvl[i] * (p - ((double) ni - 1) / 2) -
-                               g.intvl[j] * (q - ((double) nj - 1) / 2));
+                    double d = fabs(pos[i][p] - pos[j][q]);
 
                     // d = (d - g.beta[i]) / g.phi[i];
                     // d = exp(-d * d) / g.n_cell[i];
-                    double start = (g.beta[i] < 0)? 0 : g.beta[i];
-                    double end = start + g.phi[i];
-                    if (end > 1) end = 1;
 
                     // double res = d * g.polarity[i] * aff;
                     // double res = d;
@@ -66,8 +368,8 @@ void Retina::init(Genome &g)
                     // else
                     if (d >= start && d <= end)
                     {
-                        w[i][j](p, q) = aff / (g.n_cell[i] * 2 * (end - start));
-                        g.n_synapses += 1;
+                        wij(p, q) = weight;
+                        e.n_synapses += 1;
                     }
 
                     // if (res > maxi) maxi = res;
@@ -98,14 +400,93 @@ void Retina::init(Genome &g)
             //         }
             //     }
             // }
+            g.n_synapses += e.n_synapses;
         }
     }
+    g.dirty = 0;
 }
 
-void Retina::react(const MatrixXd &in, MatrixXd &out, const Genome &g)
+/*
+ * Rows are independent, so with threads > 1 they are split into blocks
+ * sized to keep a block's layer states in L2 across the T steps.
+ * Returns the fraction of the fixed-T layer work that was done; bound, if
+ * given, gets the error bound of the fast paths (0 for fixed T).
+ */
+double Retina::react(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+                     const Genome &g, const int threads, double *bound)
 {
-    MatrixXd s_old[n];
-    MatrixXd s_new[n];
+    PROFILE_SCOPE(PH_REACT);
+
+    int r = in.rows();
+    if (threads <= 1) return react_rows(in, out, g, bound);
+
+    long row_bytes = in.cols();
+    for (int i = 0; i < n; i++) row_bytes += 3 * n_cell[i]; // Old, new, temp
+    row_bytes *= sizeof(double);
+
+    int nb = block_rows(row_bytes, r, threads);
+    int n_blocks = (r + nb - 1) / nb;
+    std::vector<double> work(n_blocks), bounds(n_blocks);
+    out.resize(r, n_cell[n-1]);
+
+    PROFILE_OWNER;
+    Arena &owner = ARENA;
+    #pragma omp parallel num_threads(threads)
+    {
+        #pragma omp for schedule(dynamic)
+        for (int b = 0; b < n_blocks; b++)
+        {
+            int b0 = b * nb, len = std::min(nb, r - b0);
+            MatrixXd block_out;
+            work[b] = react_rows(in.middleRows(b0, len), block_out, g,
+                                 &bounds[b]) * len;
+            out.middleRows(b0, len) = block_out;
+        }
+        PROFILE_MERGE;
+        ARENA.settle(owner);
+    }
+
+    double total = 0;
+    for (int b = 0; b < n_blocks; b++) total += work[b];
+    if (bound) *bound = *std::max_element(bounds.begin(), bounds.end());
+    return total / r;
+}
+
+double Retina::react_rows(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+                          const Genome &g, double *bound)
+{
+    if (REACT_K > 1) return react_exp(in, out, g, REACT_K, bound);
+    if (REACT_TOL > 0) return react_adaptive(in, out, g, REACT_TOL, bound);
+
+    react_fixed(in, out, g);
+    if (bound) *bound = 0;
+    return 1;
+}
+
+// The potentials of every layer after step t, a row at a time
+static void record_states(const std::vector<Eigen::Map<MatrixXd>> &s,
+                          const int t, const Probe *probe)
+{
+    std::vector<float> v;
+    for (size_t l = 0; l < s.size(); l++)
+        for (int i = 0; i < s[l].rows(); i++)
+        {
+            v.resize(s[l].cols());
+            for (int c = 0; c < s[l].cols(); c++) v[c] = s[l](i, c);
+            RECORDER.event(EV_STATE, l, probe->source, probe->rows[i], t,
+                           v.data(), v.size());
+        }
+}
+
+// With a probe, the spikes and every probe->every steps the layer states
+// of each row go to RECORDER
+void Retina::react_fixed(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+                         const Genome &g, const Probe *probe)
+{
+    ArenaScope scope(ARENA);
+    std::vector<Eigen::Map<MatrixXd>> s_old, s_new;
+    s_old.reserve(n);
+    s_new.reserve(n);
 
     int r = in.rows();
 
@@ -113,16 +494,21 @@ void Retina::react(const MatrixXd &in, MatrixXd &out, const Genome &g)
 
     for (int i = 0; i < n; i++)
     {
-        s_old[i].noalias() = MatrixXd::Ones(r, n_cell[i]) * 0.5;
+        s_old.push_back(ARENA.matrix(r, n_cell[i]));
+        s_old[i].setConstant(0.5);
+        s_new.push_back(ARENA.matrix(r, n_cell[i]));
     }
 
     // MatrixXd spikes(r, n_cell[n-1]);
+    std::vector<uint32_t> fired;
+    if (probe) fired.reserve(n_cell[n-1]);
 
     for (int t = 0; t < T; t++)
     {
         for (int i = 0; i < n; i++)
         {
-            s_new[i].noalias() = MatrixXd::Zero(r, n_cell[i]);
+            PROFILE_SCOPE(PH_LAYER + i);
+            s_new[i].setZero();
 
             // From j to i
             for (int j = 0; j < n - 1; j++)
@@ -141,7 +527,9 @@ void Retina::react(const MatrixXd &in, MatrixXd &out, const Genome &g)
                 // if (cos(fabs(g.axon[j] - g.dendrite[i])) <= 0) continue;
 
                 // V_j * W_ji
-                s_new[i].noalias() += s_old[j] * w[j][i];
+                if (edge[j][i].sparse)
+                    s_new[i].noalias() += s_old[j] * edge[j][i].sw;
+                else s_new[i].noalias() += s_old[j] * W(j, i);
             }
             if (i == 0) s_new[i].noalias() += in;
 
@@ -169,11 +557,7 @@ void Retina::react(const MatrixXd &in, MatrixXd &out, const Genome &g)
 
         for (int i = 0; i < n - 1; i++) // New becomes old
         {
-            MatrixXd mask(s_new[i].rows(), s_new[i].cols());
-            mask.noalias() = (s_new[i].array() > 0).cast<double>().matrix();
-            s_old[i].array() = s_new[i].array() * mask.array();
-            mask.noalias() = (s_old[i].array() > 1).cast<double>().matrix();
-            s_old[i].array() = s_old[i].array() * (1 - mask.array()) + mask.array();
+            s_old[i] = s_new[i].cwiseMax(0.0).cwiseMin(1.0);
             // std::cout << s_old[i] << std::endl;
         }
 
@@ -190,9 +574,18 @@ void Retina::react(const MatrixXd &in, MatrixXd &out, const Genome &g)
 
                 // if (t >= T/2)
                 out(i, j)++;
+                if (probe) fired.push_back(j);
             }
+
+            if (!probe || fired.empty()) continue;
+            RECORDER.event(EV_SPIKES, n - 1, probe->source, probe->rows[i], t,
+                           fired.data(), fired.size());
+            fired.clear();
         }
 
+        if (probe && probe->every > 0 && t % probe->every == 0)
+            record_states(s_old, t, probe);
+
         // for (int i = 0; i < n; i++) // test
         // {
         //     std::cout << s_old[i] << std::endl;
@@ -210,6 +603,582 @@ void Retina::react(const MatrixXd &in, MatrixXd &out, const Genome &g)
     //     out.col(i) = (out.col(i) - o_min).array() / (o_max - o_min).array();
 }
 
+// Genomes stacked for react_batch; buffers are in the caller's arena
+struct Batch
+{
+    int cells, m, q; // Receptors, stacked interneurons, stacked ganglion cells
+    double r0; // Receptor resistance
+    std::vector<int> members, off, len, g_off, g_len;
+    std::vector<double> th;
+    std::vector<double *> w_gang; // Per member, len x g_len
+    double *w_in, *r_in, *r_gang; // cells x m, m, q
+};
+
+// react_fixed of every member of b on rows b0... of their outputs
+static void react_stacked(const Eigen::Ref<const MatrixXd> &in, const Batch &b,
+                          MatrixXd *out, const int b0)
+{
+    ArenaScope scope(ARENA);
+    int r = in.rows();
+    Eigen::Map<const MatrixXd> w_in(b.w_in, b.cells, b.m);
+    Eigen::Map<const Eigen::RowVectorXd> r_in(b.r_in, b.m);
+    Eigen::Map<const Eigen::RowVectorXd> r_gang(b.r_gang, b.q);
+
+    Eigen::Map<MatrixXd> s0 = ARENA.matrix(r, b.cells);
+    Eigen::Map<MatrixXd> s0_new = ARENA.matrix(r, b.cells);
+    Eigen::Map<MatrixXd> s = ARENA.matrix(r, b.m);
+    Eigen::Map<MatrixXd> s_new = ARENA.matrix(r, b.m);
+    Eigen::Map<MatrixXd> v = ARENA.matrix(r, b.q);
+    Eigen::Map<MatrixXd> v_new = ARENA.matrix(r, b.q);
+    s0.setConstant(0.5);
+    s.setConstant(0.5);
+    v.setConstant(0.5);
+
+    for (int k : b.members) out[k].middleRows(b0, r).setZero();
+
+    for (int t = 0; t < T; t++)
+    {
+        // Receptors, shared by the whole batch
+        s0_new.noalias() = in * b.r0;
+        s0_new -= s0;
+        s0_new.array() += 0.5;
+        s0_new = s0 + 1.0/TAU * s0_new;
+
+        // Every interneuron layer of every member in one GEMM
+        s_new.noalias() = s0 * w_in;
+        s_new.array().rowwise() *= r_in.array();
+        s_new -= s;
+        s_new.array() += 0.5;
+        s_new = s + 1.0/TAU * s_new;
+
+        // Ganglion cells, one GEMM per member over its stacked interneurons
+        for (size_t k = 0; k < b.members.size(); k++)
+        {
+            if (b.len[k] == 0)
+            {
+                v_new.middleCols(b.g_off[k], b.g_len[k]).setZero();
+                continue;
+            }
+            v_new.middleCols(b.g_off[k], b.g_len[k]).noalias() =
+                s.middleCols(b.off[k], b.len[k]) *
+                Eigen::Map<const MatrixXd>(b.w_gang[k], b.len[k], b.g_len[k]);
+        }
+        v_new.array().rowwise() *= r_gang.array();
+        v_new -= v;
+        v_new.array() += 0.5;
+        v_new = v + 1.0/TAU * v_new;
+
+        s0 = s0_new.cwiseMax(0.0).cwiseMin(1.0);
+        s = s_new.cwiseMax(0.0).cwiseMin(1.0);
+
+        // Reset
+        for (size_t k = 0; k < b.members.size(); k++)
+        {
+            double th = b.th[k];
+            MatrixXd &o = out[b.members[k]];
+            for (int j = 0; j < b.g_len[k]; j++)
+            {
+                int c = b.g_off[k] + j;
+                for (int i = 0; i < r; i++)
+                {
+                    v(i, c) = v_new(i, c); // New becomes old
+
+                    if (v(i, c) < th) continue;
+
+                    v(i, c) = -th / 2;
+                    o(b0 + i, j)++;
+                }
+            }
+        }
+    }
+
+    for (int k : b.members) out[k].middleRows(b0, r) /= (double) T;
+}
+
+/*
+ * react_fixed of n genomes on the same input. Genomes with the same
+ * receptor layer share its states, and all their interneuron layers are
+ * stacked column-wise, so each step drives them with one wide GEMM
+ * instead of a skinny one per layer per genome. Batches hold at most
+ * REACT_BATCH genomes; batches and row blocks run on up to threads.
+ */
+void Retina::react_batch(const MatrixXd &in, const Genome *g, const int n,
+                         MatrixXd *out, const int threads)
+{
+    PROFILE_SCOPE(PH_REACT);
+    ArenaScope scope(ARENA);
+    int r = in.rows();
+
+    std::vector<Batch> batches;
+    std::map<std::pair<int, double>, size_t> open; // Receptor layer -> batch
+    for (int k = 0; k < n; k++)
+    {
+        std::pair<int, double> key(g[k].r->n_cell[0], g[k].resistance[0]);
+        auto it = open.find(key);
+        if (it == open.end() ||
+            (int) batches[it->second].members.size() >= std::max(1, REACT_BATCH))
+        {
+            batches.push_back(Batch());
+            batches.back().cells = key.first;
+            batches.back().r0 = key.second;
+            open[key] = batches.size() - 1;
+        }
+        batches[open[key]].members.push_back(k);
+    }
+
+    long row_bytes = in.cols();
+    for (Batch &b : batches)
+    {
+        b.m = b.q = 0;
+        for (int k : b.members)
+        {
+            const Retina &rk = *g[k].r;
+            b.off.push_back(b.m);
+            b.g_off.push_back(b.q);
+            for (int i = 1; i < rk.n - 1; i++) b.m += rk.n_cell[i];
+            b.q += rk.n_cell[rk.n-1];
+            b.len.push_back(b.m - b.off.back());
+            b.g_len.push_back(b.q - b.g_off.back());
+            b.th.push_back(rk.th);
+        }
+        row_bytes = std::max(row_bytes, in.cols() + 2L * (b.cells + b.m + b.q));
+
+        b.w_in = ARENA.alloc(b.cells * b.m);
+        b.r_in = ARENA.alloc(b.m);
+        b.r_gang = ARENA.alloc(b.q);
+        Eigen::Map<MatrixXd> w_in(b.w_in, b.cells, b.m);
+
+        for (size_t k = 0; k < b.members.size(); k++)
+        {
+            const Genome &gk = g[b.members[k]];
+            const Retina &rk = *gk.r;
+            int last = rk.n - 1;
+
+            b.w_gang.push_back(ARENA.alloc(b.len[k] * b.g_len[k]));
+            Eigen::Map<MatrixXd> w_gang(b.w_gang[k], b.len[k], b.g_len[k]);
+
+            for (int i = 1, c = b.off[k]; i < last; c += rk.n_cell[i++])
+            {
+                int ni = rk.n_cell[i];
+                if (rk.edge[0][i].ni) rk.dense(0, i, w_in.middleCols(c, ni));
+                else w_in.middleCols(c, ni).setZero();
+
+                if (rk.edge[i][last].ni)
+                    rk.dense(i, last, w_gang.middleRows(c - b.off[k], ni));
+                else w_gang.middleRows(c - b.off[k], ni).setZero();
+
+                std::fill(b.r_in + c, b.r_in + c + ni, gk.resistance[i]);
+            }
+            std::fill(b.r_gang + b.g_off[k], b.r_gang + b.g_off[k] + b.g_len[k],
+                      gk.resistance[last]);
+
+            out[b.members[k]].resize(r, b.g_len[k]);
+        }
+    }
+    row_bytes *= sizeof(double);
+
+    // The stacked states outgrow the cache long before a single genome's
+    // do, so rows are blocked even on one thread
+    int nb = block_rows(row_bytes, r, threads);
+    int n_blocks = (r + nb - 1) / nb;
+    int n_tasks = batches.size() * n_blocks;
+
+    Arena &owner = ARENA;
+    #pragma omp parallel num_threads(threads) if (threads > 1)
+    {
+        #pragma omp for schedule(dynamic)
+        for (int task = 0; task < n_tasks; task++)
+        {
+            int b0 = (task % n_blocks) * nb, len = std::min(nb, r - b0);
+            react_stacked(in.middleRows(b0, len), batches[task / n_blocks],
+                          out, b0);
+        }
+        ARENA.settle(owner);
+    }
+}
+
+// Rows of m listed in rows, into dst
+static void gather(const Eigen::Ref<const MatrixXd> &m,
+                   const std::vector<int> &rows, Eigen::Ref<MatrixXd> dst)
+{
+    for (size_t k = 0; k < rows.size(); k++) dst.row(k) = m.row(rows[k]);
+}
+
+/*
+ * Same dynamics as react_fixed, but a row whose non-spiking layers all
+ * moved by less than tol in one step is taken as settled: its ganglion
+ * drive is frozen and the row is compacted out of the receptor and
+ * interneuron updates, leaving only the elementwise ganglion integration.
+ * Each layer relaxes by a factor (1 - 1/TAU) per step, so a state that
+ * moved by less than tol has at most tol * TAU left to drift, and an
+ * interneuron also follows its receptors' drift through its weights.
+ * bound gets the resulting bound on the frozen ganglion input, the drift
+ * times resistance and gain() of the layers feeding it; 0 if no row
+ * settled. Returns the fraction of non-spiking row-steps computed.
+ */
+double Retina::react_adaptive(const Eigen::Ref<const MatrixXd> &in,
+                              MatrixXd &out, const Genome &g, const double tol,
+                              double *bound)
+{
+    ArenaScope scope(ARENA);
+    int r = in.rows(), ng = n_cell[n-1], nc = in.cols();
+
+    // Active rows are compacted into the head of each buffer, through its
+    // spare twin
+    double *s[MAX_TYPES], *s_new[MAX_TYPES];
+    for (int i = 0; i < n - 1; i++)
+    {
+        s[i] = ARENA.alloc((size_t) r * n_cell[i]);
+        s_new[i] = ARENA.alloc((size_t) r * n_cell[i]);
+        Eigen::Map<MatrixXd>(s[i], r, n_cell[i]).setConstant(0.5);
+    }
+
+    std::vector<int> act(r); // Rows still being integrated
+    for (int k = 0; k < r; k++) act[k] = k;
+    double *in_a = ARENA.alloc((size_t) r * nc);
+    double *in_spare = ARENA.alloc((size_t) r * nc);
+    Eigen::Map<MatrixXd>(in_a, r, nc) = in;
+
+    Eigen::Map<MatrixXd> v = ARENA.matrix(r, ng); // Ganglion potentials
+    Eigen::Map<MatrixXd> drive = ARENA.matrix(r, ng); // Their input
+    double *d_buf = ARENA.alloc((size_t) r * ng);
+    double *change_buf = ARENA.alloc(r);
+    v.setConstant(0.5);
+    drive.setZero();
+    out = MatrixXd::Zero(r, ng);
+
+    long computed = 0;
+    bool settled = false;
+    std::vector<int> keep, keep_k, done_k;
+
+    for (int t = 0; t < T; t++)
+    {
+        int na = act.size();
+        if (na > 0)
+        {
+            computed += na;
+
+            // Ganglion drive of the active rows from last step's states
+            Eigen::Map<MatrixXd> d(d_buf, na, ng);
+            d.setZero();
+            for (int j = 1; j < n - 1; j++)
+                project(Eigen::Map<MatrixXd>(s[j], na, n_cell[j]), j, n - 1,
+                        d);
+            for (int k = 0; k < na; k++) drive.row(act[k]) = d.row(k);
+
+            // Receptors from the input, interneurons from the receptors
+            Eigen::Map<Eigen::VectorXd> change(change_buf, na);
+            change.setZero();
+            for (int i = 0; i < n - 1; i++)
+            {
+                PROFILE_SCOPE(PH_LAYER + i);
+                Eigen::Map<MatrixXd> si(s[i], na, n_cell[i]);
+                Eigen::Map<MatrixXd> si_new(s_new[i], na, n_cell[i]);
+
+                if (i == 0)
+                    si_new = Eigen::Map<MatrixXd>(in_a, na, nc) * g.resistance[i];
+                else
+                {
+                    project(Eigen::Map<MatrixXd>(s[0], na, n_cell[0]), 0, i,
+                            si_new, false);
+                    si_new *= g.resistance[i];
+                }
+
+                si_new = si + 1.0/TAU * (si_new - si);
+                si_new.array() += 0.5/TAU;
+            }
+
+            for (int i = 0; i < n - 1; i++) // New becomes old, clamped
+            {
+                Eigen::Map<MatrixXd> si(s[i], na, n_cell[i]);
+                Eigen::Map<MatrixXd> si_new(s_new[i], na, n_cell[i]);
+                si_new = si_new.cwiseMax(0.0).cwiseMin(1.0);
+                change = change.cwiseMax(
+                    (si_new - si).cwiseAbs().rowwise().maxCoeff());
+                std::swap(s[i], s_new[i]);
+            }
+
+            // Compact settled rows out, once there are enough of them
+            keep.clear();
+            keep_k.clear();
+            done_k.clear();
+            for (int k = 0; k < na; k++)
+            {
+                if (change(k) < tol) done_k.push_back(k);
+                else
+                {
+                    keep.push_back(act[k]);
+                    keep_k.push_back(k);
+                }
+            }
+
+            if (!done_k.empty() && (done_k.size() * 16 >= (size_t) na ||
+                                    keep.empty()))
+            {
+                settled = true;
+                int nd = done_k.size(), nk = keep_k.size();
+
+                // Final drive of the settled rows from their settled states
+                Eigen::Map<MatrixXd> dd(d_buf, nd, ng);
+                dd.setZero();
+                for (int j = 1; j < n - 1; j++)
+                {
+                    Eigen::Map<MatrixXd> sd(s_new[j], nd, n_cell[j]);
+                    gather(Eigen::Map<MatrixXd>(s[j], na, n_cell[j]), done_k,
+                           sd);
+                    project(sd, j, n - 1, dd);
+                }
+                for (int k = 0; k < nd; k++) drive.row(act[done_k[k]]) = dd.row(k);
+
+                for (int i = 0; i < n - 1; i++)
+                {
+                    Eigen::Map<MatrixXd> sk(s_new[i], nk, n_cell[i]);
+                    gather(Eigen::Map<MatrixXd>(s[i], na, n_cell[i]), keep_k,
+                           sk);
+                    std::swap(s[i], s_new[i]);
+                }
+                Eigen::Map<MatrixXd> in_k(in_spare, nk, nc);
+                gather(Eigen::Map<MatrixXd>(in_a, na, nc), keep_k, in_k);
+                std::swap(in_a, in_spare);
+                act.swap(keep);
+            }
+        }
+
+        {
+            PROFILE_SCOPE(PH_LAYER + n - 1);
+            v = v + 1.0/TAU * (drive * g.resistance[n-1] - v);
+            v.array() += 0.5/TAU;
+        }
+
+        // Reset
+        for (int i = 0; i < r; i++)
+        {
+            for (int j = 0; j < ng; j++)
+            {
+                if (v(i, j) < th) continue;
+
+                v(i, j) = -th / 2;
+                out(i, j)++;
+            }
+        }
+    }
+    out /= (double)T; // firing rates
+
+    if (bound)
+    {
+        double drift = 0;
+        for (int j = 1; j < n - 1; j++)
+            drift += gain(j, n - 1) * tol * TAU *
+                     (1 + g.resistance[j] * gain(0, j));
+        *bound = settled? g.resistance[n-1] * drift : 0;
+    }
+
+    return (double) computed / ((double) r * T);
+}
+
+/*
+ * Between clamp events a non-spiking layer with input held constant over
+ * the step follows s_m = u + a^m (s_0 - u), with a = 1 - 1/TAU and
+ * u = R * I + 0.5, which is exactly what m Euler steps give. Receptor
+ * input is constant, so receptors are exact; interneurons hold their
+ * receptor input at its value at the start of each k-step macro-step.
+ * The ganglion drive is then linear in a^m as well, so each macro-step
+ * costs two drive GEMMs and one per interneuron layer instead of k of
+ * each, while the ganglion keeps its fine steps for the spikes. Rows in
+ * which an interneuron would hit a clamp bound within the macro-step are
+ * stepped through it with plain Euler steps.
+ * bound gets the largest error of the ganglion input over the macro-steps
+ * from holding the receptors: they move by at most |u - s| (1 - a^k).
+ * Returns the fraction of row-steps that needed layer GEMMs.
+ */
+double Retina::react_exp(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+                         const Genome &g, const int k, double *bound)
+{
+    ArenaScope scope(ARENA);
+    int r = in.rows(), ng = n_cell[n-1], widest = 0;
+    double a = 1 - 1.0/TAU;
+    std::vector<Eigen::Map<MatrixXd>> s, u;
+    s.reserve(n - 1);
+    u.reserve(n - 1);
+
+    for (int i = 0; i < n - 1; i++)
+    {
+        s.push_back(ARENA.matrix(r, n_cell[i]));
+        u.push_back(ARENA.matrix(r, n_cell[i]));
+        s[i].setConstant(0.5);
+        widest = std::max(widest, n_cell[i]);
+    }
+    u[0] = in * g.resistance[0];
+    u[0].array() += 0.5;
+
+    Eigen::Map<MatrixXd> v = ARENA.matrix(r, ng); // Ganglion potentials
+    Eigen::Map<MatrixXd> d0 = ARENA.matrix(r, ng);
+    Eigen::Map<MatrixXd> d_inf = ARENA.matrix(r, ng);
+    Eigen::Map<MatrixXd> drive = ARENA.matrix(r, ng);
+    double *target_buf = ARENA.alloc((size_t) r * widest);
+    v.setConstant(0.5);
+    out = MatrixXd::Zero(r, ng);
+
+    long computed = 0;
+    double held = 0; // Ganglion input error per unit of receptor movement
+    for (int j = 1; j < n - 1; j++)
+        held += gain(j, n - 1) * g.resistance[j] * gain(0, j);
+    held *= g.resistance[n-1];
+    if (bound) *bound = 0;
+
+    std::vector<bool> cross;
+    std::vector<int> fine;
+
+    for (int t0 = 0; t0 < T; t0 += k)
+    {
+        ArenaScope step(ARENA); // The crossing rows' Euler states
+        int kk = std::min(k, T - t0);
+        double ak = pow(a, kk);
+        if (bound && r > 0)
+            *bound = std::max(*bound, held * (1 - ak) *
+                              (u[0] - s[0]).cwiseAbs().maxCoeff());
+
+        // Targets of the interneurons; clamp crossings within kk steps
+        cross.assign(r, false);
+        for (int i = 1; i < n - 1; i++)
+        {
+            PROFILE_SCOPE(PH_LAYER + i);
+            project(s[0], 0, i, u[i], false);
+            u[i] *= g.resistance[i];
+            u[i].array() += 0.5;
+
+            for (int p = 0; p < r; p++)
+            {
+                if (cross[p]) continue;
+                for (int q = 0; q < n_cell[i]; q++)
+                {
+                    double x0 = s[i](p, q), ui = u[i](p, q);
+                    if (ui >= 0 && ui <= 1) continue;
+                    if ((ui > 1 && x0 >= 1) || (ui < 0 && x0 <= 0)) continue;
+
+                    double xk = ui + ak * (x0 - ui);
+                    if (xk > 1 || xk < 0)
+                    {
+                        cross[p] = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        fine.clear();
+        for (int p = 0; p < r; p++) if (cross[p]) fine.push_back(p);
+        int nf = fine.size();
+        computed += r + (long) nf * kk;
+
+        // Drive at the start and at the end of the relaxation. A state
+        // already pinned at a bound it is pushed past stays there; any
+        // other that does not cross relaxes toward its unclamped u.
+        d0.setZero();
+        d_inf.setZero();
+        for (int j = 1; j < n - 1; j++)
+        {
+            project(s[j], j, n - 1, d0);
+            Eigen::Map<MatrixXd> target(target_buf, r, n_cell[j]);
+            target = ((u[j].array() > 1 && s[j].array() >= 1) ||
+                      (u[j].array() < 0 && s[j].array() <= 0))
+                     .select(s[j], u[j]);
+            project(target, j, n - 1, d_inf);
+        }
+
+        // Euler steps through the crossings, keeping each step's drive
+        double *d_fine = nullptr, *sf[MAX_TYPES];
+        if (nf > 0)
+        {
+            d_fine = ARENA.alloc((size_t) kk * nf * ng);
+            Eigen::Map<MatrixXd> in_f = ARENA.matrix(nf, in.cols());
+            gather(in, fine, in_f);
+
+            double *s_new[MAX_TYPES];
+            for (int i = 0; i < n - 1; i++)
+            {
+                sf[i] = ARENA.alloc((size_t) nf * n_cell[i]);
+                s_new[i] = ARENA.alloc((size_t) nf * n_cell[i]);
+                Eigen::Map<MatrixXd> sfi(sf[i], nf, n_cell[i]);
+                gather(s[i], fine, sfi);
+            }
+
+            for (int m = 0; m < kk; m++)
+            {
+                Eigen::Map<MatrixXd> dm(d_fine + (size_t) m * nf * ng, nf, ng);
+                dm.setZero();
+                for (int j = 1; j < n - 1; j++)
+                    project(Eigen::Map<MatrixXd>(sf[j], nf, n_cell[j]), j,
+                            n - 1, dm);
+
+                for (int i = 0; i < n - 1; i++)
+                {
+                    Eigen::Map<MatrixXd> sfi(sf[i], nf, n_cell[i]);
+                    Eigen::Map<MatrixXd> si_new(s_new[i], nf, n_cell[i]);
+                    if (i == 0) si_new = in_f * g.resistance[i];
+                    else
+                    {
+                        project(Eigen::Map<MatrixXd>(sf[0], nf, n_cell[0]), 0,
+                                i, si_new, false);
+                        si_new *= g.resistance[i];
+                    }
+                    si_new = sfi + 1.0/TAU * (si_new - sfi);
+                    si_new.array() += 0.5/TAU;
+                }
+                for (int i = 0; i < n - 1; i++)
+                {
+                    Eigen::Map<MatrixXd> si_new(s_new[i], nf, n_cell[i]);
+                    si_new = si_new.cwiseMax(0.0).cwiseMin(1.0);
+                    std::swap(sf[i], s_new[i]);
+                }
+            }
+        }
+
+        // Ganglion cells, in fine steps
+        {
+            PROFILE_SCOPE(PH_LAYER + n - 1);
+            double am = 1;
+            for (int m = 0; m < kk; m++, am *= a)
+            {
+                drive = d_inf + am * (d0 - d_inf);
+                if (nf > 0)
+                {
+                    Eigen::Map<MatrixXd> dm(d_fine + (size_t) m * nf * ng, nf,
+                                            ng);
+                    for (int p = 0; p < nf; p++) drive.row(fine[p]) = dm.row(p);
+                }
+
+                v = v + 1.0/TAU * (drive * g.resistance[n-1] - v);
+                v.array() += 0.5/TAU;
+
+                for (int i = 0; i < r; i++)
+                {
+                    for (int j = 0; j < ng; j++)
+                    {
+                        if (v(i, j) < th) continue;
+
+                        v(i, j) = -th / 2;
+                        out(i, j)++;
+                    }
+                }
+            }
+        }
+
+        // Jump the non-spiking layers to the end of the macro-step
+        for (int i = 0; i < n - 1; i++)
+        {
+            PROFILE_SCOPE(PH_LAYER + i);
+            s[i] = (u[i] + ak * (s[i] - u[i])).cwiseMax(0.0).cwiseMin(1.0);
+            if (nf == 0) continue;
+            Eigen::Map<MatrixXd> sfi(sf[i], nf, n_cell[i]);
+            for (int p = 0; p < nf; p++) s[i].row(fine[p]) = sfi.row(p);
+        }
+    }
+    out /= (double)T; // firing rates
+
+    return (double) computed / ((double) r * T);
+}
+
 std::ostream& operator<<(std::ostream &os, const Retina &r)
 {
     for (int i = 0; i < r.n - 1; i++)
@@ -227,12 +1196,53 @@ std::ostream& operator<<(std::ostream &os, const Retina &r)
 
             os << "# " << i << "->" << j << " "
                << r.n_cell[i] << ":" << r.n_cell[j]
-               << "\n" << r.w[i][j].format(TSV) << "\n";
+               << "\n" << r.dense(i, j).format(TSV) << "\n";
         }
     }
     return os;
 }
 
+void Retina::serialize(std::vector<char> &blob) const
+{
+    // Same edges as operator<<, as raw column-major blocks
+    std::vector<MatrixXd> edges;
+    std::vector<int32_t> ends;
+    for (int i = 0; i < n - 1; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            // Feedforward only
+            if (i == 0 && j == n - 1) continue;
+            if (i != 0 && j != n - 1) continue;
+            if (i == j) continue;
+
+            edges.push_back(dense(i, j));
+            ends.push_back(i);
+            ends.push_back(j);
+        }
+    }
+
+    uint32_t n_edges = edges.size();
+    size_t bytes = sizeof(n_edges);
+    for (const MatrixXd &e : edges)
+        bytes += 4 * sizeof(int32_t) + e.size() * sizeof(double);
+
+    blob.resize(bytes);
+    char *p = blob.data();
+    std::memcpy(p, &n_edges, sizeof(n_edges));
+    p += sizeof(n_edges);
+
+    for (size_t k = 0; k < edges.size(); k++)
+    {
+        int32_t hdr[4] = {ends[2*k], ends[2*k+1],
+                          (int32_t) edges[k].rows(), (int32_t) edges[k].cols()};
+        std::memcpy(p, hdr, sizeof(hdr));
+        p += sizeof(hdr);
+        std::memcpy(p, edges[k].data(), edges[k].size() * sizeof(double));
+        p += edges[k].size() * sizeof(double);
+    }
+}
+
 Genome::Genome()
 {
     n_types = uniform(2, MAX_TYPES);
@@ -261,6 +1271,10 @@ Genome::Genome()
 
     resistance[0] = 1;
 
+    front = 0;
+    crowding = 0;
+    screened = false;
+    dirty = ALL_LAYERS;
     organize();
 }
 
@@ -304,8 +1318,6 @@ void Genome::organize()
     total_cost = 0;
     i2e = 1.0 / CELLS;
 
-    if (n_types == 2) return;
-
     // double inh = 0, exc = CELLS;
 
     bool rm[n_types];
@@ -336,6 +1348,7 @@ void Genome::organize()
     {
         if (!rm[i]) continue;
 
+        dirty |= ALL_LAYERS & ~((1u << i) - 1); // Layers from i on move down
         for (int j = i; j < n_types - 1; j++)
         {
             n_cell[j] = n_cell[j+1];
@@ -350,7 +1363,8 @@ void Genome::organize()
 
     n_types = n_aux;
 
-
+    // Every layer's, two-layer genomes included, so that none is kept from
+    // an archive or a client
     for (int i = 0; i < n_types; i++)
     {
         intvl[i] = 1.0 / n_cell[i];
@@ -362,6 +1376,34 @@ void Genome::organize()
     // i2e = inh / exc;
 }
 
+/*
+ * The genome as GENOME_DIMS features, for niching and the surrogate: its
+ * size, th, then 8 per layer, and layers past n_types zero. Angles are
+ * points on a circle of radius 1/2 about 0, so their features lie in
+ * [-0.5, 0.5], the others in [0, 1]; a missing layer's angles sit at the
+ * centre, as far from every angle.
+ */
+void Genome::embed(double *f) const
+{
+    std::fill(f, f + GENOME_DIMS, 0.0);
+    f[0] = (double) n_types / MAX_TYPES;
+    f[1] = (th - 0.6) / 0.4;
+
+    for (int j = 0; j < n_types; j++)
+    {
+        double *l = f + 2 + 8 * j;
+        l[0] = (double) n_cell[j] / CELLS;
+        l[1] = phi[j] / 0.5;
+        l[2] = beta[j] + 0.5;
+        l[3] = resistance[j] / 2;
+        // Chords of the unit circle, at most 1 apart
+        l[4] = cos(axon[j]) / 2;
+        l[5] = sin(axon[j]) / 2;
+        l[6] = cos(dendrite[j]) / 2;
+        l[7] = sin(dendrite[j]) / 2;
+    }
+}
+
 std::ostream & operator<<(std::ostream &os, const Genome &g)
 {
     os << "n_types\tganglion_th\ttest_loss\tn_synapses\n";
@@ -3,12 +3,17 @@
 
 #define EIGEN_USE_MKL_ALL
 #include <iostream>
+#include <vector>
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
 using Eigen::MatrixXd;
 
 #define MAX_TYPES 7
+#define ALL_LAYERS ((1 << MAX_TYPES) - 1) // Genome::dirty of a new genome
+#define GENOME_DIMS (2 + 8 * MAX_TYPES) // Of Genome::embed
 
 class Retina;
+struct Probe;
 
 struct Genome
 {
@@ -36,26 +41,69 @@ struct Genome
     double fit_cost; // Fitness cost, the larger the worse
 	int n_synapses;
 	double total_cost;
+	int front; // Pareto front of the last ranking, 0 the best
+	double crowding; // Crowding distance within it
+	bool screened; // Passed over by the surrogate, so not evaluated
 
 	Retina *r;
+	unsigned dirty; // Bit i: layer i changed since r was built from this
 
 	Genome();
 	void organize();
+	void embed(double *f) const;
 	friend std::ostream & operator<<(std::ostream &os, const Genome &g);
 };
 
 class Retina
 {
 public:
+	Retina();
 	void init(Genome &g);
-	void react(const MatrixXd &in, MatrixXd &out, const Genome &g);
+	double react(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+	             const Genome &g, const int threads = 1,
+	             double *bound = nullptr);
+	double react_rows(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+	                  const Genome &g, double *bound = nullptr);
+	void react_fixed(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+	                 const Genome &g, const Probe *probe = nullptr);
+	double react_adaptive(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+	                      const Genome &g, const double tol,
+	                      double *bound = nullptr);
+	double react_exp(const Eigen::Ref<const MatrixXd> &in, MatrixXd &out,
+	                 const Genome &g, const int k, double *bound = nullptr);
+	static void react_batch(const MatrixXd &in, const Genome *g, const int n,
+	                        MatrixXd *out, const int threads = 1);
+	void serialize(std::vector<char> &blob) const;
 	friend std::ostream & operator<<(std::ostream &os, const Retina &r);
 
+	// Weights of an edge, with the lattice and range they were built for
+	struct Edge
+	{
+		std::vector<double> w; // Empty when sparse
+		int ni = 0, nj = 0, aff = 0, n_synapses = 0;
+		double intvl_i = 0, intvl_j = 0, start = 0, end = 0;
+		Eigen::SparseMatrix<double> sw; // Instead of w, if few are connected
+		bool sparse = false; // sw is set and w is not
+	};
+	static void connect_2d(Edge &e, const double *pi, const double *pj,
+	                       const double weight); // Public for check
+
 private:
 	int n; // Number of types
 	double th; // Ganglion cell firing threshold
 	int n_cell[MAX_TYPES];
-	MatrixXd w[MAX_TYPES-1][MAX_TYPES];
+	Edge edge[MAX_TYPES-1][MAX_TYPES]; // Kept across init()s
+
+	Eigen::Map<const MatrixXd> W(const int i, const int j) const;
+	void project(const Eigen::Ref<const MatrixXd> &s, const int i,
+	             const int j, Eigen::Ref<MatrixXd> out,
+	             const bool add = true) const;
+	void dense(const int i, const int j, Eigen::Ref<MatrixXd> dst) const;
+	double gain(const int i, const int j) const;
+	MatrixXd dense(const int i, const int j) const;
+	static void move_range(Edge &e, const double *pi, const double *pj,
+	                       const double start, const double end,
+	                       const double weight);
 };
 
 #endif
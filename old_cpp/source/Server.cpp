@@ -0,0 +1,285 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "Server.h"
+#include "Threads.h"
+#include "tool.h"
+
+// The socket, removed when the server is stopped
+static char SOCKET_PATH[sizeof(sockaddr_un::sun_path)];
+
+static void stop(int)
+{
+    unlink(SOCKET_PATH);
+    _exit(0);
+}
+
+static bool read_all(const int fd, void *p, size_t n)
+{
+    char *b = (char *) p;
+    while (n > 0)
+    {
+        ssize_t k = recv(fd, b, n, 0);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        b += k;
+        n -= k;
+    }
+    return true;
+}
+
+static bool write_all(const int fd, const void *p, size_t n)
+{
+    const char *b = (const char *) p;
+    while (n > 0)
+    {
+        ssize_t k = send(fd, b, n, MSG_NOSIGNAL);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return false;
+        b += k;
+        n -= k;
+    }
+    return true;
+}
+
+// In [lo, hi], which NaN is not
+static bool within(const double v, const double lo, const double hi)
+{
+    return v >= lo && v <= hi;
+}
+
+// Within the ranges Genome() and mutate() keep genomes to, which init()
+// relies on. intvl is not the client's to set: score() organizes each
+// genome, which derives it from n_cell
+static bool valid(const GenomeRecord &rec)
+{
+    int n = rec.n_types;
+    if (n < 2 || n > MAX_TYPES || rec.n_cell[0] != CELLS ||
+        rec.n_cell[n - 1] < 1 || !within(rec.th, 0.6, 1.0))
+        return false;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (rec.n_cell[i] < 0 || rec.n_cell[i] > CELLS ||
+            !within(rec.axon[i], 0.0, M_PI * 2) ||
+            !within(rec.dendrite[i], 0.0, M_PI * 2) ||
+            !within(rec.phi[i], 0.0, 0.5) ||
+            !within(rec.beta[i], -0.5, 0.5) ||
+            !within(rec.resistance[i], 0.0, 2.0))
+            return false;
+    }
+    return true;
+}
+
+Server::Conn::~Conn()
+{
+    close(fd);
+}
+
+Server::Server(const MatrixXd &x_, const MatrixXd &y_)
+    : x(x_), y(y_), fd(-1), backlog(SERVE_BACKLOG * POPULATION) {}
+
+bool Server::listen(const std::string &path)
+{
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path.c_str());
+    strcpy(SOCKET_PATH, path.c_str());
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+
+    unlink(path.c_str()); // Left over by a server that was killed
+    if (bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0 ||
+        ::listen(fd, 64) < 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    return true;
+}
+
+// Accepts clients until the process is stopped
+void Server::run()
+{
+    std::thread([this]() { work(); }).detach();
+
+    while (true)
+    {
+        int c = accept(fd, nullptr, nullptr);
+        if (c < 0) continue;
+
+        uint32_t hello[3] = {SERVE_VERSION, sizeof(GenomeRecord), MAX_TYPES};
+        if (!write_all(c, "RGEV", 4) || !write_all(c, hello, sizeof(hello)))
+        {
+            close(c);
+            continue;
+        }
+
+        std::shared_ptr<Conn> conn = std::make_shared<Conn>(c);
+        std::thread([this, conn]() { read(conn); }).detach();
+        std::thread([this, conn]() { write(conn); }).detach();
+    }
+}
+
+// Queues the genomes of c's requests, POPULATION at a time, until it
+// disconnects, waiting while the queue is full. c is closed once the last
+// of its replies is sent.
+void Server::read(std::shared_ptr<Conn> c)
+{
+    uint32_t n;
+    std::vector<Job> jobs;
+    bool open = true;
+
+    while (open && read_all(c->fd, &n, sizeof(n)))
+    {
+        for (uint32_t i = 0; open && i < n; )
+        {
+            jobs.clear();
+            for (; open && i < n && (int) jobs.size() < POPULATION; i++)
+            {
+                jobs.push_back({c, i, {}});
+                open = read_all(c->fd, &jobs.back().rec, sizeof(GenomeRecord));
+            }
+            if (!open) break; // A request cut short is dropped
+
+            {
+                std::lock_guard<std::mutex> guard(c->m);
+                c->pending += jobs.size();
+            }
+            {
+                std::unique_lock<std::mutex> lock(m);
+                room.wait(lock, [this]() { return queue.size() < backlog; });
+                queue.insert(queue.end(), jobs.begin(), jobs.end());
+            }
+            arrived.notify_one();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(c->m);
+        c->read_done = true;
+    }
+    c->ready.notify_one();
+}
+
+// Sends c's replies as the worker scores them, until c has disconnected
+// and all of its genomes are answered
+void Server::write(std::shared_ptr<Conn> c)
+{
+    std::vector<ScoreReply> out;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(c->m);
+            c->ready.wait(lock, [&c]()
+                          { return !c->out.empty() ||
+                                   (c->read_done && c->pending == 0); });
+            if (c->out.empty()) return;
+            out.assign(c->out.begin(), c->out.end());
+            c->out.clear();
+        }
+
+        if (!c->lost)
+            c->lost = !write_all(c->fd, out.data(),
+                                 out.size() * sizeof(ScoreReply));
+    }
+}
+
+// The evaluation loop, on the cores of GA thread 0
+void Server::work()
+{
+    pin_worker(0);
+
+    std::vector<Genome> g(POPULATION);
+    std::vector<Retina> r(POPULATION);
+    GA sim(g.data(), r.data());
+    std::vector<Job> batch;
+
+    // Totals since the last progress line
+    long genomes = 0, batches = 0;
+    double busy = 0;
+    std::chrono::steady_clock::time_point report =
+        std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            arrived.wait(lock, [this]() { return !queue.empty(); });
+
+            // Let more requests join, unless a batch is already there
+            std::chrono::steady_clock::time_point until =
+                std::chrono::steady_clock::now()
+                + std::chrono::milliseconds(SERVE_WAIT);
+            arrived.wait_until(lock, until, [this]()
+                               { return (int) queue.size() >= POPULATION; });
+
+            int n = std::min((int) queue.size(), POPULATION);
+            batch.assign(queue.begin(), queue.begin() + n);
+            queue.erase(queue.begin(), queue.begin() + n);
+        }
+        room.notify_all();
+
+        std::chrono::steady_clock::time_point t0 =
+            std::chrono::steady_clock::now();
+
+        // The valid genomes first, into the population
+        std::vector<int> at(batch.size(), -1);
+        int n = 0;
+        for (size_t k = 0; k < batch.size(); k++)
+        {
+            if (!valid(batch[k].rec)) continue;
+            restore(g[n], batch[k].rec);
+            at[k] = n++;
+        }
+        if (n > 0) sim.score(x, y, n);
+
+        // Replies go to the connections' writers, a request's at a time
+        for (size_t k = 0; k < batch.size(); )
+        {
+            Conn &c = *batch[k].c;
+            {
+                std::lock_guard<std::mutex> guard(c.m);
+                for (; k < batch.size() && batch[k].c.get() == &c; k++)
+                {
+                    ScoreReply rep = {batch[k].index, -1, NAN};
+                    if (at[k] >= 0)
+                    {
+                        rep.n_synapses = g[at[k]].n_synapses;
+                        rep.fit_cost = g[at[k]].fit_cost;
+                    }
+                    c.out.push_back(rep);
+                    c.pending--;
+                }
+            }
+            c.ready.notify_one();
+        }
+        batch.clear();
+
+        std::chrono::steady_clock::time_point t1 =
+            std::chrono::steady_clock::now();
+        genomes += n;
+        batches++;
+        busy += std::chrono::duration<double>(t1 - t0).count();
+        if (t1 - report < std::chrono::seconds(SERVE_REPORT)) continue;
+
+        std::cout << "[serve] " << genomes << " genomes in " << batches
+                  << " batches, " << busy << " s busy" << std::endl;
+        genomes = batches = 0;
+        busy = 0;
+        report = t1;
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+#include "Archive.h"
+#include "GA.h"
+
+#define SERVE_VERSION 1
+#define SERVE_BACKLOG 4 // Batches of genomes queued before readers wait
+#define SERVE_REPORT 10 // Seconds between progress lines
+
+// Result of one genome
+struct ScoreReply
+{
+    uint32_t index; // Within its request
+    int32_t n_synapses; // -1 if the genome was not evaluated
+    double fit_cost;
+};
+
+/*
+ * Evaluation daemon. Clients of the Unix domain socket send genomes and
+ * get their fit_cost and n_synapses back, scored on the one dataset the
+ * server holds. A single worker evaluates them a batch of up to POPULATION
+ * genomes at a time, as a GA generation is, on all INNER_THREADS cores.
+ * Small requests arriving within SERVE_WAIT ms of each other share a
+ * batch; large ones are split across several, and their replies start
+ * before the whole request is read. Each connection has a reader and a
+ * writer thread, so a client slow to take its replies only holds up its
+ * own; readers stop reading while SERVE_BACKLOG batches wait. Progress
+ * goes to stdout every SERVE_REPORT seconds at most, not per batch.
+ *
+ * Protocol (native endianness):
+ *   on connect: "RGEV" | u32 version | u32 record_bytes | u32 max_types
+ *   request:    u32 n, then n GenomeRecords (Archive.h)
+ *   reply:      n ScoreReplies
+ * A connection may send requests back to back; replies follow in the
+ * order its genomes were sent. Genomes outside the ranges the GA keeps
+ * to are not evaluated and get a NaN fit_cost. See retina_io.Client.
+ */
+class Server
+{
+public:
+    Server(const MatrixXd &x, const MatrixXd &y);
+    bool listen(const std::string &path);
+    void run();
+
+private:
+    struct Conn
+    {
+        int fd;
+        bool lost = false; // A reply failed; the rest are dropped
+        std::deque<ScoreReply> out; // Scored, not yet sent
+        long pending = 0; // Queued, not yet scored
+        bool read_done = false; // Will send no more requests
+        std::mutex m; // Of the above but lost, which only the writer uses
+        std::condition_variable ready;
+        Conn(const int fd_) : fd(fd_) {}
+        ~Conn();
+    };
+
+    struct Job
+    {
+        std::shared_ptr<Conn> c;
+        uint32_t index;
+        GenomeRecord rec;
+    };
+
+    const MatrixXd &x, &y;
+    int fd;
+    std::deque<Job> queue;
+    size_t backlog; // Most genomes in queue
+    std::mutex m; // Of queue
+    std::condition_variable arrived, room;
+
+    void read(std::shared_ptr<Conn> c);
+    void write(std::shared_ptr<Conn> c);
+    void work();
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include "Stimuli.h"
+#include "tool.h"
+#include "FitnessDB.h"
+
+// frac 0 is a fixed dataset, with no producer
+Stimuli::Stimuli(const MatrixXd &sigs, const MatrixXd &st, const double frac)
+    : cur_sigs(&sigs), cur_st(&st), hashed(false), next(0), offset(0)
+{
+    n_fresh = std::min((long) sigs.rows(), (long) (frac * sigs.rows() + 0.5));
+    if (n_fresh > 0) producer = std::thread(&Stimuli::produce, this);
+}
+
+Stimuli::~Stimuli()
+{
+    if (producer.joinable()) producer.join();
+}
+
+void Stimuli::produce()
+{
+    Dataset &d = buf[next];
+    d.sigs = *cur_sigs;
+    d.st = *cur_st;
+
+    Dataset fresh;
+    generate_data(fresh.sigs, fresh.st, n_fresh);
+
+    long rows = d.sigs.rows();
+    for (long k = 0; k < n_fresh; k++)
+    {
+        long i = (offset + k) % rows;
+        d.sigs.row(i) = fresh.sigs.row(k);
+        d.st.row(i) = fresh.st.row(k);
+    }
+    offset = (offset + n_fresh) % rows;
+}
+
+void Stimuli::swap()
+{
+    if (n_fresh == 0) return;
+
+    producer.join();
+    cur_sigs = &buf[next].sigs;
+    cur_st = &buf[next].st;
+    hashed = false;
+    next ^= 1;
+    producer = std::thread(&Stimuli::produce, this);
+}
+
+// data_hash of the current dataset, computed once per swap
+uint64_t Stimuli::hash()
+{
+    if (!hashed) cur_hash = data_hash(*cur_sigs, *cur_st);
+    hashed = true;
+    return cur_hash;
+}
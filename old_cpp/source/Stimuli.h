@@ -0,0 +1,45 @@
+#ifndef STIMULI_H
+#define STIMULI_H
+
+#include <thread>
+#include <cstdint>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+#include "Dataset.h"
+using Eigen::MatrixXd;
+
+/*
+ * Double-buffered stimuli of one GA thread. While a generation is
+ * evaluated on the current dataset, a background thread prepares the
+ * next one: a copy with a fraction of its rows regenerated, taken in turn
+ * so that every row is eventually replaced. swap() at a generation
+ * boundary waits for it, which is normally long done, and starts on the
+ * one after. The data_hash of the current dataset is kept until then.
+ */
+class Stimuli
+{
+public:
+    Stimuli(const MatrixXd &sigs, const MatrixXd &st, const double frac);
+    ~Stimuli();
+
+    const MatrixXd &sigs() const { return *cur_sigs; }
+    const MatrixXd &st() const { return *cur_st; }
+    void swap();
+    uint64_t hash();
+
+private:
+    const MatrixXd *cur_sigs, *cur_st; // The given dataset until a swap
+    bool hashed;
+    uint64_t cur_hash; // Of cur_sigs, cur_st once hashed
+    Dataset buf[2];
+    int next; // Buffer being produced
+    long n_fresh, offset; // Rows regenerated, from row offset on
+    std::thread producer;
+
+    void produce();
+
+    Stimuli(const Stimuli &) = delete;
+    Stimuli &operator=(const Stimuli &) = delete;
+};
+
+#endif
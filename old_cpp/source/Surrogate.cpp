@@ -0,0 +1,40 @@
+#include <cmath>
+#include "Surrogate.h"
+#include "tool.h"
+
+#define RIDGE 1e-2
+
+// Genome::embed, after a constant for the intercept
+static Eigen::Matrix<double, N_FEATURES, 1> features(const Genome &g)
+{
+    Eigen::Matrix<double, N_FEATURES, 1> f;
+    f(0) = 1;
+    g.embed(f.data() + 1);
+    return f;
+}
+
+Surrogate::Surrogate()
+    : A(MatrixXd::Zero(N_FEATURES, N_FEATURES)),
+      b(VectorXd::Zero(N_FEATURES)), w(VectorXd::Zero(N_FEATURES)), n(0) {}
+
+void Surrogate::add(const Genome &g, const double cost)
+{
+    if (!std::isfinite(cost)) return;
+
+    Eigen::Matrix<double, N_FEATURES, 1> f = features(g);
+    A.selfadjointView<Eigen::Lower>().rankUpdate(f);
+    b += cost * f;
+    n++;
+}
+
+void Surrogate::fit()
+{
+    MatrixXd reg = A.selfadjointView<Eigen::Lower>();
+    reg.diagonal().array() += RIDGE;
+    w = reg.ldlt().solve(b);
+}
+
+double Surrogate::predict(const Genome &g) const
+{
+    return w.dot(features(g));
+}
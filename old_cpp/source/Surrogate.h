@@ -0,0 +1,35 @@
+#ifndef SURROGATE_H
+#define SURROGATE_H
+
+#include <vector>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+#include "Retina.h"
+using Eigen::MatrixXd;
+using Eigen::VectorXd;
+
+#define N_FEATURES (1 + GENOME_DIMS)
+
+/*
+ * Ridge regression of fit_cost on genome features, for screening
+ * children before their full evaluation. Every evaluation is folded into
+ * the normal equations at O(features^2); fit() solves them at
+ * O(features^3), so the model costs the same whatever it has seen.
+ */
+class Surrogate
+{
+public:
+    Surrogate();
+    void add(const Genome &g, const double cost);
+    void fit();
+    double predict(const Genome &g) const;
+    long samples() const { return n; }
+
+private:
+    MatrixXd A; // X'X
+    VectorXd b; // X'y
+    VectorXd w;
+    long n;
+};
+
+#endif
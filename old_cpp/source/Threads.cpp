@@ -0,0 +1,193 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <sched.h>
+#include <pthread.h>
+#include <omp.h>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+#include "tool.h"
+#include "Threads.h"
+
+int INNER_THREADS = 1;
+static Layout LAYOUT;
+
+// CPUs, or nodes, of a sysfs list such as "0-3,8-11"
+static std::vector<int> parse_cpulist(const std::string &s)
+{
+    std::vector<int> cpus;
+    if (s.empty()) return cpus;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        size_t dash = item.find('-');
+        int lo = std::stoi(item.substr(0, dash));
+        int hi = (dash == std::string::npos)? lo : std::stoi(item.substr(dash + 1));
+        for (int c = lo; c <= hi; c++) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+// Allowed CPUs ordered node by node, with the node of each
+static void numa_order(std::vector<int> &cpus, std::vector<int> &nodes)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    // Node ids may have gaps, so take them from the online list
+    std::string online;
+    std::ifstream f_online("/sys/devices/system/node/online");
+    f_online >> online;
+
+    for (int node : parse_cpulist(online))
+    {
+        std::ifstream f("/sys/devices/system/node/node" + std::to_string(node)
+                        + "/cpulist");
+        if (!f.is_open()) continue;
+
+        std::string list;
+        f >> list;
+        for (int c : parse_cpulist(list))
+        {
+            if (!CPU_ISSET(c, &allowed)) continue;
+            cpus.push_back(c);
+            nodes.push_back(node);
+        }
+    }
+
+    if (cpus.empty()) // No NUMA information
+    {
+        for (int c = 0; c < CPU_SETSIZE; c++)
+        {
+            if (!CPU_ISSET(c, &allowed)) continue;
+            cpus.push_back(c);
+            nodes.push_back(0);
+        }
+    }
+}
+
+// Allowed CPUs in node order
+std::vector<int> allowed_cpus()
+{
+    std::vector<int> cpus, nodes;
+    numa_order(cpus, nodes);
+    return cpus;
+}
+
+/*
+ * Split `cores` (0: all allowed CPUs) between `workers` GA threads. The
+ * inner thread count is the per-worker share, capped by the parallelism
+ * one evaluation offers: a genome each, or a 64-row block each. A share
+ * is never split across a node boundary it could have avoided.
+ */
+void plan_threads(const int cores, const int workers, const long rows,
+                  const int population)
+{
+    std::vector<int> cpus, nodes;
+    numa_order(cpus, nodes);
+
+    int budget = (cores > 0)? std::min(cores, (int) cpus.size()) : cpus.size();
+    int share = std::max(1, budget / workers);
+    long useful = std::max((long) population, rows / 64);
+
+    LAYOUT.budget = budget;
+    LAYOUT.workers = workers;
+    LAYOUT.inner = std::max(1L, std::min((long) share, useful));
+    LAYOUT.cpus.assign(workers, std::vector<int>());
+    LAYOUT.nodes.assign(workers, std::vector<int>());
+
+    // Budgeted cores come node by node: the first of each node and its size
+    std::vector<int> first, size, group(budget);
+    for (int c = 0; c < budget; c++)
+    {
+        if (c == 0 || nodes[c] != nodes[c - 1])
+        {
+            first.push_back(c);
+            size.push_back(0);
+        }
+        group[c] = first.size() - 1;
+        size.back()++;
+    }
+    const int n_nodes = first.size();
+    const int widest = *std::max_element(size.begin(), size.end());
+    std::vector<int> used(n_nodes, 0);
+    std::vector<bool> taken(budget, false);
+    int left = budget;
+
+    auto take = [&](const int w, const int c)
+    {
+        LAYOUT.cpus[w].push_back(cpus[c]);
+        std::vector<int> &spans = LAYOUT.nodes[w];
+        if (std::find(spans.begin(), spans.end(), nodes[c]) == spans.end())
+            spans.push_back(nodes[c]);
+        taken[c] = true;
+        used[group[c]]++;
+        left--;
+    };
+
+    // Each node's taken cores are a prefix of it, so a share starts at the
+    // first free core of a node with room for all of it, or, wider than
+    // any node, of the first untouched node; failing both, of any node
+    for (int w = 0; w < workers; w++)
+    {
+        int n = 0;
+        if (LAYOUT.inner <= widest)
+            while (n < n_nodes && size[n] - used[n] < LAYOUT.inner) n++;
+        else
+            while (n < n_nodes && used[n] > 0) n++;
+
+        int c = (n < n_nodes)? first[n] : 0;
+        for (int k = 0; k < LAYOUT.inner; k++)
+        {
+            if (left == 0) // Oversubscribed: hand every core out again
+            {
+                taken.assign(budget, false);
+                used.assign(n_nodes, 0);
+                left = budget;
+            }
+            while (taken[c]) c = (c + 1) % budget;
+            take(w, c);
+        }
+    }
+
+    INNER_THREADS = LAYOUT.inner;
+}
+
+// Called by GA thread tid itself, before it allocates anything large
+void pin_worker(const int tid)
+{
+    if (PIN)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : LAYOUT.cpus[tid]) CPU_SET(c, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    // Inner teams and BLAS calls of this thread stay within its share
+    omp_set_num_threads(LAYOUT.inner);
+#ifdef EIGEN_USE_MKL_ALL
+    mkl_set_num_threads_local(LAYOUT.inner);
+#endif
+}
+
+void report_threads(std::ostream &os)
+{
+    os << "threads: " << LAYOUT.budget << " cores, " << LAYOUT.workers
+       << " GA x " << LAYOUT.inner << " inner"
+       << (LAYOUT.workers * LAYOUT.inner > LAYOUT.budget? " (oversubscribed)" : "")
+       << "\n";
+
+    for (int w = 0; w < LAYOUT.workers; w++)
+    {
+        os << "  [" << w << "] node";
+        for (int n : LAYOUT.nodes[w]) os << " " << n;
+        os << ", cpus";
+        for (int c : LAYOUT.cpus[w]) os << " " << c;
+        os << "\n";
+    }
+    os << std::flush;
+}
@@ -0,0 +1,32 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <iostream>
+#include <vector>
+
+/*
+ * One core budget shared by the GA threads of fork() and the OpenMP/BLAS
+ * threads inside each of them. Every GA thread gets a disjoint set of
+ * INNER_THREADS cores, within one NUMA node when they fit in one and
+ * otherwise whole nodes from a node boundary on, and is pinned to it
+ * before it allocates its dataset and population, so that first touch
+ * places them on its node.
+ */
+struct Layout
+{
+    int budget; // Cores used in total
+    int workers; // GA threads
+    int inner; // OpenMP/BLAS threads per GA thread
+    std::vector<std::vector<int>> cpus; // Of each GA thread
+    std::vector<std::vector<int>> nodes; // NUMA nodes each GA thread spans
+};
+
+extern int INNER_THREADS;
+
+void plan_threads(const int cores, const int workers, const long rows,
+                  const int population);
+void pin_worker(const int tid);
+void report_threads(std::ostream &os);
+std::vector<int> allowed_cpus();
+
+#endif
@@ -0,0 +1,743 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <array>
+#include <limits>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+#include "Retina.h"
+#include "tool.h"
+#include "GA.h"
+#include "Profile.h"
+#include "Arena.h"
+#include "Pareto.h"
+
+/*
+ * Micro and macro benchmarks of the simulation kernels.
+ *
+ *   ./Benchmark [output.json] [key=v1,v2,...]...
+ *   ./Benchmark check [trials]
+ *
+ * Grid keys: cells, T, types, rows, population. Each case is repeated
+ * until it has run for at least min_time seconds (default 0.2). One JSON
+ * record is written per line; compare runs with bench_compare.py.
+ *
+ * check instead compares retinas rebuilt incrementally, and the elites
+ * CMA-ES refined, against ones built from scratch, react_batch against
+ * react_fixed, the cell list of 2-D edges against all pairs, and Pareto
+ * ranks against a naive sort, checks that no screened genome is chosen as
+ * a parent, and exits with 1 on any failure.
+ */
+
+struct Case
+{
+    int cells, t, n_types, rows, population;
+};
+
+struct Result
+{
+    double seconds; // Per repetition
+    int reps;
+    double allocs, bytes; // Per repetition
+};
+
+double MIN_TIME = 0.2;
+
+Result measure(const std::function<void()> &body)
+{
+    typedef std::chrono::steady_clock clock;
+
+    body(); // Warm up
+
+    Result res = {0, 0, 0, 0};
+    long a0 = ALLOCS, b0 = ALLOC_BYTES; // Of this thread
+    clock::time_point t0 = clock::now();
+    double elapsed = 0;
+
+    while (elapsed < MIN_TIME || res.reps < 3)
+    {
+        body();
+        res.reps++;
+        elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+    }
+
+    res.seconds = elapsed / res.reps;
+    res.allocs = (double) (ALLOCS - a0) / res.reps;
+    res.bytes = (double) (ALLOC_BYTES - b0) / res.reps;
+    return res;
+}
+
+// A genome with exactly n_types layers, none of which organize() removes
+Genome make_genome(const int n_types)
+{
+    Genome g;
+    g.n_types = n_types;
+
+    for (int i = 0; i < n_types; i++)
+    {
+        g.n_cell[i] = CELLS / 2;
+        g.axon[i] = uniform(0.0, M_PI * 2);
+        g.dendrite[i] = uniform(0.0, M_PI * 2);
+        g.phi[i] = uniform(0.05, 0.5);
+        g.beta[i] = uniform(-0.5, 0.5);
+        g.resistance[i] = uniform(0.5, 2.0);
+    }
+
+    g.n_cell[0] = CELLS;
+    g.resistance[0] = 1;
+
+    g.organize();
+    return g;
+}
+
+void emit(std::ostream &os, const std::string &name, const Case &c,
+          const Result &res, const double items, const std::string &unit)
+{
+    os << "{\"bench\": \"" << name << "\", \"cells\": " << c.cells
+       << ", \"T\": " << c.t << ", \"types\": " << c.n_types
+       << ", \"rows\": " << c.rows << ", \"population\": " << c.population
+       << ", \"reps\": " << res.reps << ", \"seconds\": " << res.seconds
+       << ", \"throughput\": " << items / res.seconds
+       << ", \"unit\": \"" << unit << "\", \"allocs\": " << res.allocs
+       << ", \"alloc_bytes\": " << res.bytes << "}" << std::endl;
+}
+
+std::vector<int> parse_list(const std::string &s)
+{
+    std::vector<int> v;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) v.push_back(std::stoi(item));
+    return v;
+}
+
+// Steps of g as mutation() and organize() take them, some larger: moved
+// ranges, flipped affinities, a cell more or less, a layer removed
+void perturb(Genome &g)
+{
+    for (int i = 0; i < g.n_types; i++)
+    {
+        if (uniform(0, 99) < 50) continue;
+        double step = (uniform(0, 99) < 80)? 0.01 : 0.2;
+
+        g.beta[i] = std::min(0.5, std::max(-0.5, g.beta[i] +
+                                                 uniform(-step, step)));
+        g.phi[i] = std::min(0.5, std::max(0.0, g.phi[i] +
+                                               uniform(-step, step) / 2));
+        if (uniform(0, 99) < 10) g.axon[i] = uniform(0.0, M_PI * 2);
+        if (uniform(0, 99) < 10) g.dendrite[i] = uniform(0.0, M_PI * 2);
+        g.dirty |= 1u << i;
+
+        if (i == 0 || i == g.n_types - 1) continue;
+        if (uniform(0, 99) < 10)
+            g.n_cell[i] = std::min(CELLS, std::max(0, g.n_cell[i] +
+                                                      uniform(-1, 1)));
+        if (uniform(0, 99) < 2) g.resistance[i] = 0;
+    }
+}
+
+// Whether r holds the weights and g the synapse count of a fresh build
+bool same_as_fresh(const Genome &g, const Retina &r)
+{
+    Retina fresh;
+    Genome h = g;
+    h.n_synapses = 0;
+    h.dirty = ALL_LAYERS;
+    h.r = &fresh;
+    fresh.init(h);
+
+    std::vector<char> a, b;
+    r.serialize(a);
+    fresh.serialize(b);
+    return g.n_synapses == h.n_synapses && a.size() == b.size() &&
+           std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+// Chains of incremental rebuilds, on each layout, against fresh builds
+int check(const int trials)
+{
+    int bad = 0, n = 0;
+    for (int mosaic = 0; mosaic <= 2; mosaic++)
+    {
+        MOSAIC = mosaic;
+        for (int t = 0; t < trials; t++)
+        {
+            Genome g;
+            Retina r;
+            g.r = &r;
+            r.init(g);
+
+            for (int k = 0; k < 20; k++, n++)
+            {
+                perturb(g);
+                g.organize();
+                r.init(g);
+                if (same_as_fresh(g, r)) continue;
+
+                if (bad++ < 10)
+                    std::cerr << "mosaic " << mosaic << " trial " << t
+                              << " step " << k << ": rebuild differs\n"
+                              << g;
+            }
+        }
+    }
+    MOSAIC = 0;
+
+    std::cout << "init: " << bad << " of " << n << " rebuilds differ"
+              << std::endl;
+    return bad;
+}
+
+// fit_cost with NaN the worst, as refine() takes it
+double cost_of(const Genome &g)
+{
+    return (g.fit_cost != g.fit_cost)? std::numeric_limits<double>::infinity()
+                                     : g.fit_cost;
+}
+
+// Elites CMA-ES replaced, and the rest, against fresh builds; replacements
+// only ever improve an elite, so the best fit_cost never gets worse, and
+// some happen
+int check_refine(const int trials)
+{
+    POPULATION = 20; ELITES = 4;
+    CMAES_ELITES = ELITES; CMAES_ITERS = 2; CMAES_LAMBDA = 6;
+    TRAIN_SIZE = 50; TEST_SIZE = 10; T = 20;
+
+    int bad = 0, worse = 0, refined = 0;
+    MatrixXd sigs, st;
+    for (int t = 0; t < trials; t++)
+    {
+        generate(sigs, st, TRAIN_SIZE + TEST_SIZE, 1);
+        std::vector<Genome> g(POPULATION);
+        std::vector<Retina> r(POPULATION);
+        GA sim(g.data(), r.data());
+        sim.score(sigs, st, POPULATION);
+
+        std::vector<Genome> before = g;
+        sim.refine(sigs, st);
+
+        double best_before = cost_of(*std::min_element(
+            before.begin(), before.end(), [](const Genome &a, const Genome &b)
+            { return cost_of(a) < cost_of(b); }));
+        double best_after = cost_of(*std::min_element(
+            g.begin(), g.end(), [](const Genome &a, const Genome &b)
+            { return cost_of(a) < cost_of(b); }));
+        if (best_after > best_before && worse++ < 10)
+            std::cerr << "trial " << t << ": best fit_cost " << best_before
+                      << " refined to " << best_after << "\n";
+
+        for (int k = 0; k < POPULATION; k++)
+        {
+            // A replaced elite has every continuous parameter moved, and
+            // rank() may have moved it anywhere; it keeps its retina
+            bool replaced = std::none_of(before.begin(), before.end(),
+                                         [&](const Genome &b)
+                                         { return b.th == g[k].th &&
+                                                  std::equal(b.beta,
+                                                             b.beta + b.n_types,
+                                                             g[k].beta); });
+            if (replaced)
+            {
+                refined++;
+                const Genome &e = *std::find_if(before.begin(), before.end(),
+                    [&](const Genome &b) { return b.r == g[k].r; });
+                if (cost_of(g[k]) > cost_of(e) && worse++ < 10)
+                    std::cerr << "trial " << t << ": elite of fit_cost "
+                              << e.fit_cost << " replaced by one of "
+                              << g[k].fit_cost << "\n";
+            }
+            if (!same_as_fresh(g[k], *g[k].r)) bad++;
+        }
+    }
+
+    std::cout << "refine: " << bad << " of " << trials * POPULATION
+              << " genomes differ, " << refined << " refined, " << worse
+              << " worse" << std::endl;
+    if (refined == 0) std::cout << "refine: no elite was refined" << std::endl;
+    return bad + worse + (refined == 0);
+}
+
+/*
+ * Parents drawn from ranked populations with from none to all of their
+ * children screened, in both selection modes: no screened genome is ever
+ * one, so long as three genomes were evaluated.
+ */
+int check_select(const int trials)
+{
+    POPULATION = 20; ELITES = 4;
+    const double inf = std::numeric_limits<double>::infinity();
+    const int pareto = PARETO;
+
+    int bad = 0, n = 0;
+    for (int t = 0; t < trials; t++)
+    {
+        std::vector<Genome> g(POPULATION);
+        std::vector<Retina> r(POPULATION);
+        GA sim(g.data(), r.data());
+
+        int screened = uniform(0, POPULATION - ELITES);
+        for (int i = 0; i < POPULATION; i++)
+        {
+            g[i].screened = i >= POPULATION - screened;
+            g[i].fit_cost = g[i].screened? std::nan("") : uniform(0.0, 1.0);
+            g[i].total_cost = g[i].screened? inf : g[i].fit_cost;
+        }
+
+        // In rank()'s order, which puts the screened last
+        PARETO = t % 2;
+        if (PARETO) pareto_rank(g.data(), POPULATION);
+        std::stable_sort(g.begin(), g.end(), [&](const Genome &a,
+                                                 const Genome &b)
+                         { return PARETO? pareto_better(a, b) :
+                                  a.total_cost < b.total_cost; });
+
+        for (int k = 0; k < POPULATION; k++, n++)
+        {
+            int p1 = sim.select_p(-1), p2 = sim.select_p(p1);
+            if (!g[p1].screened && !g[p2].screened) continue;
+
+            if (bad++ < 10)
+                std::cerr << "trial " << t << ": parents " << p1 << ", " << p2
+                          << " of " << screened << " screened\n";
+        }
+    }
+    PARETO = pareto;
+
+    std::cout << "select: " << bad << " of " << n
+              << " parent pairs screened" << std::endl;
+    return bad;
+}
+
+// x, y of n cells on a hexagonal grid of spacing a, or jittered on a
+// square one by up to half a spacing, from a corner at (x0, y0)
+std::vector<double> layout_2d(const int n, const double a, const bool hex,
+                              const double x0, const double y0)
+{
+    int k = std::ceil(std::sqrt((double) n));
+    std::vector<double> pos(2 * n);
+    for (int p = 0; p < n; p++)
+    {
+        double x = x0 + a * (p % k), y = y0 + a * (p / k);
+        if (hex)
+        {
+            if ((p / k) & 1) x += a / 2;
+            y = y0 + (y - y0) * std::sqrt(3.0) / 2;
+        }
+        else
+        {
+            x += uniform(-a / 2, a / 2);
+            y += uniform(-a / 2, a / 2);
+        }
+        pos[2 * p] = x;
+        pos[2 * p + 1] = y;
+    }
+    return pos;
+}
+
+// connect_2d's synapses against every pair's distance, on hexagonal and
+// jittered layers of different sizes and offsets
+int check_2d(const int trials)
+{
+    int bad = 0, n = 0;
+    for (int t = 0; t < trials; t++)
+    {
+        for (bool hex : {true, false})
+        {
+            int ni = uniform(1, 120), nj = uniform(1, 120);
+            std::vector<double> pi = layout_2d(ni, 1.0 / std::sqrt(ni), hex,
+                                               uniform(-0.6, -0.4),
+                                               uniform(-0.6, -0.4));
+            std::vector<double> pj = layout_2d(nj, 1.0 / std::sqrt(nj), hex,
+                                               -0.5, -0.5);
+
+            Retina::Edge e;
+            e.ni = ni;
+            e.nj = nj;
+            e.start = (uniform(0, 1) == 0)? 0 : uniform(0.0, 0.3);
+            e.end = e.start + uniform(0.0, 0.5);
+            Retina::connect_2d(e, pi.data(), pj.data(), 0.25);
+
+            MatrixXd w = e.sparse? MatrixXd(e.sw) :
+                         Eigen::Map<MatrixXd>(e.w.data(), ni, nj);
+            int found = 0;
+            bool same = true;
+            for (int p = 0; p < ni; p++)
+            {
+                for (int q = 0; q < nj; q++)
+                {
+                    double dx = pi[2 * p] - pj[2 * q];
+                    double dy = pi[2 * p + 1] - pj[2 * q + 1];
+                    double d = std::sqrt(dx * dx + dy * dy);
+                    bool in = d >= e.start && d <= e.end;
+                    found += in;
+                    same = same && w(p, q) == (in? 0.25 : 0.0);
+                }
+            }
+
+            n++;
+            if (same && found == e.n_synapses) continue;
+            if (bad++ < 10)
+                std::cerr << "trial " << t << (hex? " hexagonal" : " jittered")
+                          << " " << ni << " x " << nj << " in [" << e.start
+                          << ", " << e.end << "]: cell list differs\n";
+        }
+    }
+
+    std::cout << "2d: " << bad << " of " << n << " edges differ" << std::endl;
+    return bad;
+}
+
+// pareto_rank's objectives: NaN fit_cost the worst, screened worse still
+std::array<double, 3> objectives(const Genome &g)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    if (g.screened) return {inf, inf, inf};
+
+    std::array<double, 3> f = {g.fit_cost, (double) g.n_synapses, 0};
+    if (f[0] != f[0]) f[0] = inf;
+    for (int i = 0; i < g.n_types; i++) f[2] += g.n_cell[i];
+    for (int k = 0; k < 3; k++) if (W_COST(k) == 0) f[k] = 0;
+    return f;
+}
+
+/*
+ * pareto_rank against the O(M N^2) sort it replaces: fronts peeled off one
+ * at a time by checking every pair, and NSGA-II crowding distances, with
+ * ties in index order and any non-finite gap infinite. Costs include
+ * duplicates, +inf and -inf, NaN, and screened genomes.
+ */
+int check_pareto(const int trials)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    const int pop = 40;
+    const Eigen::Matrix<double, 3, 1> w_cost = W_COST;
+    std::vector<Genome> g(pop);
+
+    int bad = 0, n = 0;
+    for (int t = 0; t < trials; t++)
+    {
+        for (int k = 0; k < 3; k++) W_COST(k) = uniform(0, 3) * 0.5;
+        for (int i = 0; i < pop; i++)
+        {
+            int c = uniform(0, 9);
+            g[i].fit_cost = (c == 0)? inf : (c == 1)? -inf : (c == 2)? nan :
+                            uniform(0, 5) * 0.1;
+            g[i].n_synapses = uniform(0, 8);
+            g[i].n_types = 3;
+            for (int l = 0; l < 3; l++) g[i].n_cell[l] = uniform(1, 4);
+            g[i].screened = uniform(0, 19) == 0;
+        }
+
+        pareto_rank(g.data(), pop);
+
+        std::vector<std::array<double, 3>> f(pop);
+        for (int i = 0; i < pop; i++) f[i] = objectives(g[i]);
+
+        auto dominates = [&](int a, int b)
+        {
+            bool better = false;
+            for (int k = 0; k < 3; k++)
+            {
+                if (f[a][k] > f[b][k]) return false;
+                better = better || f[a][k] < f[b][k];
+            }
+            return better;
+        };
+
+        std::vector<int> front(pop, -1);
+        std::vector<double> crowding(pop, 0);
+        for (int rank = 0, left = pop; left > 0; rank++)
+        {
+            std::vector<int> members;
+            for (int a = 0; a < pop; a++)
+            {
+                if (front[a] != -1) continue;
+                bool dominated = false;
+                for (int b = 0; b < pop && !dominated; b++)
+                    dominated = (front[b] == -1 || front[b] == rank) &&
+                                dominates(b, a);
+                if (!dominated) members.push_back(a);
+            }
+            for (int a : members) front[a] = rank;
+            left -= members.size();
+
+            for (int k = 0; k < 3; k++)
+            {
+                if (W_COST(k) == 0) continue;
+                std::sort(members.begin(), members.end(), [&](int a, int b)
+                          { return f[a][k] < f[b][k] ||
+                                   (f[a][k] == f[b][k] && a < b); });
+
+                double lo = f[members.front()][k], hi = lo;
+                for (int a : members) if (f[a][k] < inf) hi = f[a][k];
+                crowding[members.front()] = crowding[members.back()] = inf;
+                if (hi == lo) continue;
+
+                for (size_t m = 1; m + 1 < members.size(); m++)
+                {
+                    double gap = f[members[m + 1]][k] - f[members[m - 1]][k];
+                    crowding[members[m]] += (gap < inf)?
+                                            W_COST(k) * gap / (hi - lo) : inf;
+                }
+            }
+        }
+
+        for (int i = 0; i < pop; i++, n++)
+        {
+            if (g[i].front == front[i] && g[i].crowding == crowding[i])
+                continue;
+
+            if (bad++ < 10)
+                std::cerr << "trial " << t << " genome " << i << ": front "
+                          << g[i].front << " crowding " << g[i].crowding
+                          << ", naive " << front[i] << " " << crowding[i]
+                          << "\n";
+        }
+    }
+    W_COST = w_cost;
+
+    std::cout << "pareto: " << bad << " of " << n << " ranks differ"
+              << std::endl;
+    return bad;
+}
+
+// react_batch of a population on 1 and 4 threads against react_fixed of
+// each genome, bit for bit
+int check_batch(const int trials)
+{
+    const int pop = 37; // Not a multiple of the batch size
+    REACT_BATCH = 8; T = 20;
+
+    int bad = 0, n = 0;
+    MatrixXd sigs, st;
+    for (int t = 0; t < trials; t++)
+    {
+        generate(sigs, st, 60, 1);
+        std::vector<Genome> g(pop);
+        std::vector<Retina> r(pop);
+        std::vector<MatrixXd> out(pop), ref(pop);
+        for (int k = 0; k < pop; k++)
+        {
+            if (k % 4 == 0) g[k] = make_genome(2 + k % (MAX_TYPES - 1));
+            g[k].r = &r[k];
+            g[k].dirty = ALL_LAYERS;
+            r[k].init(g[k]);
+            r[k].react_fixed(sigs, ref[k], g[k]);
+        }
+
+        for (int threads : {1, 4})
+        {
+            Retina::react_batch(sigs, g.data(), pop, out.data(), threads);
+            for (int k = 0; k < pop; k++, n++)
+            {
+                if (out[k].rows() == ref[k].rows() &&
+                    out[k].cols() == ref[k].cols() && out[k] == ref[k])
+                    continue;
+
+                if (bad++ < 10)
+                    std::cerr << "trial " << t << " threads " << threads
+                              << " genome " << k << ": react_batch differs\n"
+                              << g[k];
+            }
+        }
+    }
+
+    std::cout << "batch: " << bad << " of " << n << " reactions differ"
+              << std::endl;
+    return bad;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> cells = {50, 100}, ts = {20, 100}, types = {3, 7},
+                     rows = {100, 600}, pops = {20};
+
+    // Fixed model parameters, as in param_template
+    THREADS = 1; ITERS = 1; EPOCHS = 40;
+    TAU = 10; ETA = 0.25; NOISE = 0.1; DICISION_BOUNDARY = 0; XRATE = 30;
+    FOLDER = "/tmp";
+
+    if (argc > 1 && std::string(argv[1]) == "check")
+    {
+        CELLS = 40; EPOCHS = 5;
+        int trials = (argc > 2)? std::stoi(argv[2]) : 1000;
+        int bad = check(trials);
+        bad += check_refine(std::max(1, trials / 20));
+        bad += check_batch(std::max(1, trials / 300));
+        bad += check_2d(trials);
+        bad += check_pareto(std::max(1, trials / 10));
+        bad += check_select(std::max(1, trials / 10));
+        return bad > 0;
+    }
+
+    std::string fname = "bench.json";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        size_t eq = arg.find('=');
+        if (eq == std::string::npos) { fname = arg; continue; }
+
+        std::string key = arg.substr(0, eq), val = arg.substr(eq + 1);
+        if (key == "cells") cells = parse_list(val);
+        else if (key == "T") ts = parse_list(val);
+        else if (key == "types") types = parse_list(val);
+        else if (key == "rows") rows = parse_list(val);
+        else if (key == "population") pops = parse_list(val);
+        else if (key == "min_time") MIN_TIME = std::stod(val);
+        else
+        {
+            std::cerr << "Unknown key " << key << std::endl;
+            std::exit(1);
+        }
+    }
+
+    std::ofstream out(fname);
+    std::streambuf *cout_buf = std::cout.rdbuf();
+
+    for (int n_cells : cells)
+    {
+        CELLS = n_cells;
+
+        for (int n_rows : rows)
+        {
+            TRAIN_SIZE = n_rows * 5 / 6;
+            TEST_SIZE = n_rows - TRAIN_SIZE;
+
+            MatrixXd sigs, st;
+            Case c = {n_cells, 0, 0, n_rows, 1};
+
+            std::cout.rdbuf(nullptr); // run() prints its progress
+            Result res = measure([&]() { generate(sigs, st, n_rows, 1); });
+            emit(out, "generate", c, res, n_rows, "samples/s");
+
+            MatrixXd buffer = MatrixXd::Random(n_rows, CELLS) * NOISE;
+            res = measure([&]()
+            {
+                MatrixXd filtered = MatrixXd::Zero(n_rows, CELLS);
+                gaussian_filter(filtered, buffer, n_rows);
+            });
+            emit(out, "gaussian_filter", c, res, n_rows, "samples/s");
+
+            res = measure([&]() { nn(sigs, st); });
+            emit(out, "nn", c, res, (double) n_rows * EPOCHS,
+                 "sample-epochs/s");
+
+            for (int n_types : types)
+            {
+                c.n_types = n_types;
+                Genome g = make_genome(n_types);
+                Retina r;
+                g.r = &r;
+
+                c.t = 0;
+                res = measure([&]()
+                {
+                    ARENA.reset(); // As at each generation
+                    Retina fresh; // A full build
+                    Genome h = g;
+                    h.n_synapses = 0;
+                    h.r = &fresh;
+                    fresh.init(h);
+                });
+                emit(out, "init", c, res, 1, "retinas/s");
+
+                // A rebuild after mutation() nudged every layer's range
+                Genome h = g;
+                res = measure([&]()
+                {
+                    for (int i = 0; i < h.n_types; i++)
+                    {
+                        h.beta[i] = g.beta[i] + uniform(-0.01, 0.01);
+                        h.phi[i] = g.phi[i] + uniform(-0.005, 0.005);
+                        h.dirty |= 1u << i;
+                    }
+                    h.n_synapses = 0;
+                    r.init(h);
+                });
+                emit(out, "init_mutated", c, res, 1, "retinas/s");
+                g.dirty = ALL_LAYERS;
+                r.init(g);
+
+                for (int t : ts)
+                {
+                    T = c.t = t;
+                    MatrixXd retina_out;
+                    res = measure([&]() { r.react(sigs, retina_out, g); });
+                    emit(out, "react", c, res, (double) n_rows * t,
+                         "sample-timesteps/s");
+                }
+            }
+
+            // The same, a population of same-shaped genomes at a time
+            for (int n_types : types)
+            {
+                c.n_types = n_types;
+                for (int pop : pops)
+                {
+                    c.population = pop;
+                    std::vector<Genome> g(pop);
+                    std::vector<Retina> r(pop);
+                    std::vector<MatrixXd> retina_out(pop);
+                    ARENA.reset();
+                    for (int k = 0; k < pop; k++)
+                    {
+                        g[k] = make_genome(n_types);
+                        g[k].r = &r[k];
+                        r[k].init(g[k]);
+                    }
+
+                    for (int t : ts)
+                    {
+                        T = c.t = t;
+                        res = measure([&]()
+                        {
+                            Retina::react_batch(sigs, g.data(), pop,
+                                                retina_out.data());
+                        });
+                        emit(out, "react_batch", c, res,
+                             (double) pop * n_rows * t, "sample-timesteps/s");
+                    }
+                }
+            }
+            c.population = 1;
+
+            // One generation of a whole population (plus the final eval)
+            c.n_types = 0;
+            for (int t : ts)
+            {
+                T = c.t = t;
+                for (int pop : pops)
+                {
+                    POPULATION = c.population = pop;
+                    ELITES = pop / 10;
+
+                    res = measure([&]()
+                    {
+                        std::vector<Genome> g(POPULATION);
+                        std::vector<Retina> r(POPULATION);
+                        GA sim(g.data(), r.data());
+                        sim.run(sigs, st, 0);
+                    });
+                    emit(out, "ga_generation", c, res,
+                         2.0 * pop * n_rows * t, "sample-timesteps/s");
+                }
+            }
+            std::cout.rdbuf(cout_buf);
+            std::cout << "cells " << n_cells << " rows " << n_rows
+                      << " done" << std::endl;
+        }
+    }
+
+    out.close();
+    return 0;
+}
@@ -0,0 +1,44 @@
+#! /usr/bin/env python3
+"""Compare two Benchmark outputs case by case.
+
+    ./bench_compare.py [baseline.json] [current.json] [tolerance, default 0.1]
+
+Prints the throughput ratio current / baseline of every case found in
+both files and exits with 1 if any case slowed down by more than the
+tolerance.
+"""
+import sys
+import json
+
+KEY = ('bench', 'cells', 'T', 'types', 'rows', 'population')
+
+def load(fname):
+    with open(fname, 'r') as f:
+        records = [json.loads(l) for l in f if l.strip()]
+    return {tuple(r[k] for k in KEY): r for r in records}
+
+if __name__ == '__main__':
+    if len(sys.argv) not in (3, 4):
+        print(__doc__)
+        sys.exit(1)
+
+    base, cur = load(sys.argv[1]), load(sys.argv[2])
+    tol = float(sys.argv[3]) if len(sys.argv) == 4 else 0.1
+
+    slower = 0
+    print('%-16s %6s %5s %5s %6s %10s %10s %10s' %
+          (KEY + ('speedup', 'allocs')))
+    for k in sorted(set(base) & set(cur), key=str):
+        speedup = cur[k]['throughput'] / base[k]['throughput']
+        flag = ''
+        if speedup < 1 - tol:
+            slower += 1
+            flag = ' *'
+        print('%-16s %6d %5d %5d %6d %10d %10.3f %10.0f%s' %
+              (k + (speedup, cur[k]['allocs'], flag)))
+
+    missing = set(base) ^ set(cur)
+    if missing:
+        print('%d cases only in one file' % len(missing))
+
+    sys.exit(1 if slower else 0)
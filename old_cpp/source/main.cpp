@@ -1,15 +1,126 @@
 #include <iostream>
 #include <fstream>
 #include <thread>
+#include <vector>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <algorithm>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 #define EIGEN_USE_MKL_ALL
 #include <Eigen/Dense>
 #include "Retina.h"
 #include "tool.h"
 #include "GA.h"
+#include "Archive.h"
+#include "Profile.h"
+#include "Threads.h"
+#include "Arena.h"
+#include "Dataset.h"
+#include "FitnessDB.h"
+#include "Recorder.h"
+#include "Server.h"
 
 // thread_local int TID;
 
-void read_param(char *param)
+void read_option(std::ifstream &f, const std::string key)
+{
+    if (key == "log_format") f >> LOG_FORMAT;
+    else if (key == "elite_format") f >> ELITE_FORMAT;
+    else if (key == "cores") f >> CORES;
+    else if (key == "pin") f >> PIN;
+    else if (key == "eval_parallel") f >> EVAL_PARALLEL;
+    else if (key == "react_tol") f >> REACT_TOL;
+    else if (key == "react_k") f >> REACT_K;
+    else if (key == "react_check") f >> REACT_CHECK;
+    else if (key == "react_batch") f >> REACT_BATCH;
+    else if (key == "shared_data") f >> SHARED_DATA;
+    else if (key == "data_file") f >> DATA_FILE;
+    else if (key == "stream_rows") f >> STREAM_ROWS;
+    else if (key == "refresh") f >> REFRESH;
+    else if (key == "refresh_frac") f >> REFRESH_FRAC;
+    else if (key == "mosaic") f >> MOSAIC;
+    else if (key == "pareto") f >> PARETO;
+    else if (key == "w_cost") f >> W_COST(0) >> W_COST(1) >> W_COST(2);
+    else if (key == "tasks") f >> W_TASKS(0) >> W_TASKS(1) >> W_TASKS(2);
+    else if (key == "cmaes") f >> CMAES_EVERY;
+    else if (key == "cmaes_elites") f >> CMAES_ELITES;
+    else if (key == "cmaes_iters") f >> CMAES_ITERS;
+    else if (key == "cmaes_lambda") f >> CMAES_LAMBDA;
+    else if (key == "fitness_db") f >> DB_FILE;
+    else if (key == "db_seed") f >> DB_SEED;
+    else if (key == "record")
+        f >> RECORD_GENOMES >> RECORD_ROWS >> RECORD_EVERY;
+    else if (key == "serve") f >> SERVE_SOCKET;
+    else if (key == "serve_wait") f >> SERVE_WAIT;
+    else if (key == "niche") f >> NICHE;
+    else if (key == "niche_radius") f >> NICHE_RADIUS;
+    else if (key == "surrogate") f >> SURROGATE;
+    else if (key == "surrogate_explore") f >> SURROGATE_EXPLORE;
+    else if (key == "trace")
+    {
+        int on;
+        f >> on;
+        trace_enable(on);
+    }
+    else
+    {
+        std::string skip; // Unknown option; drop its value
+        f >> skip;
+    }
+}
+
+// The options a param file may leave out. A sweep restores their defaults
+// before each config, since read_param() only sets those it finds.
+struct Options
+{
+    int log_format, elite_format, cores, pin, eval_parallel, react_k,
+        react_check, react_batch, shared_data, stream_rows, refresh, mosaic,
+        pareto, cmaes_every, cmaes_elites, cmaes_iters, cmaes_lambda, db_seed,
+        niche, record_genomes, record_rows, record_every;
+    double react_tol, refresh_frac, surrogate, surrogate_explore,
+           niche_radius;
+    Eigen::Matrix<double, 3, 1> w_cost, w_tasks;
+    std::string data_file, db_file;
+    bool trace;
+};
+
+Options save_options()
+{
+    return {LOG_FORMAT, ELITE_FORMAT, CORES, PIN, EVAL_PARALLEL, REACT_K,
+            REACT_CHECK, REACT_BATCH, SHARED_DATA, STREAM_ROWS, REFRESH,
+            MOSAIC, PARETO, CMAES_EVERY, CMAES_ELITES, CMAES_ITERS,
+            CMAES_LAMBDA, DB_SEED, NICHE, RECORD_GENOMES, RECORD_ROWS,
+            RECORD_EVERY, REACT_TOL, REFRESH_FRAC, SURROGATE,
+            SURROGATE_EXPLORE, NICHE_RADIUS, W_COST, W_TASKS, DATA_FILE,
+            DB_FILE, trace_enabled()};
+}
+
+void load_options(const Options &o)
+{
+    LOG_FORMAT = o.log_format; ELITE_FORMAT = o.elite_format;
+    CORES = o.cores; PIN = o.pin; EVAL_PARALLEL = o.eval_parallel;
+    REACT_K = o.react_k; REACT_CHECK = o.react_check;
+    REACT_BATCH = o.react_batch; REACT_TOL = o.react_tol;
+    SHARED_DATA = o.shared_data; STREAM_ROWS = o.stream_rows;
+    REFRESH = o.refresh; REFRESH_FRAC = o.refresh_frac; MOSAIC = o.mosaic;
+    PARETO = o.pareto; W_COST = o.w_cost; W_TASKS = o.w_tasks;
+    CMAES_EVERY = o.cmaes_every; CMAES_ELITES = o.cmaes_elites;
+    CMAES_ITERS = o.cmaes_iters; CMAES_LAMBDA = o.cmaes_lambda;
+    SURROGATE = o.surrogate; SURROGATE_EXPLORE = o.surrogate_explore;
+    NICHE = o.niche; NICHE_RADIUS = o.niche_radius;
+    RECORD_GENOMES = o.record_genomes; RECORD_ROWS = o.record_rows;
+    RECORD_EVERY = o.record_every;
+    DATA_FILE = o.data_file; DB_FILE = o.db_file; DB_SEED = o.db_seed;
+    trace_enable(o.trace);
+}
+
+void read_param(const std::string &param)
 {
     char aux[50];
 
@@ -23,6 +134,9 @@ void read_param(char *param)
           >> aux >> NOISE
           >> aux >> TRAIN_SIZE >> aux >> TEST_SIZE
           >> aux >> DICISION_BOUNDARY;
+
+        // Optional trailing options, in any order
+        while (f >> aux) read_option(f, aux);
         f.close();
 
     } else
@@ -41,8 +155,107 @@ void test_reading()
               << "\n" << DICISION_BOUNDARY << "\n" << std::endl;
 }
 
+Archive ARCHIVE;
+
+// Datasets by data parameters, then by GA thread (just one when shared).
+// A run fills it before its GA threads start, if they share one; a sweep
+// fills each entry just before forking the first config that reads it,
+// copy-on-write, and drops it once the last one has forked.
+std::map<std::string, std::vector<Dataset>> DATASETS;
+
+std::string data_key()
+{
+    std::ostringstream key;
+    key.precision(17);
+    key << CELLS << " " << TRAIN_SIZE << " " << TEST_SIZE << " " << NOISE
+        << " " << DICISION_BOUNDARY << " " << W_TASKS.transpose() << " "
+        << DATA_FILE;
+    return key.str();
+}
+
+bool shared_data()
+{
+    return SHARED_DATA || !DATA_FILE.empty();
+}
+
+// data_file read a chunk at a time instead of loaded
+bool streaming()
+{
+    return STREAM_ROWS > 0 && !DATA_FILE.empty();
+}
+
+// Target columns of generate_data()
+int n_targets()
+{
+    if (multitask()) return 4;
+    return (DICISION_BOUNDARY != 0)? 1 : 2;
+}
+
+void check_shape(const long rows, const long cells, const long targets)
+{
+    if (cells == CELLS && rows == TRAIN_SIZE + TEST_SIZE &&
+        targets == n_targets())
+        return;
+
+    std::cout << "Dataset " << DATA_FILE << " is " << rows << " x " << cells
+              << " with " << targets << " targets, not train_size + "
+              << "test_size x max_num_cells with " << n_targets() << "."
+              << std::endl;
+    std::exit(1);
+}
+
+// The datasets of the current config, one per GA thread unless shared
+void prepare_datasets()
+{
+    if (streaming() && multitask())
+    {
+        std::cout << "tasks needs the dataset in memory; drop stream_rows."
+                  << std::endl;
+        std::exit(1);
+    }
+
+    if (streaming())
+    { // Written a chunk at a time, if it is not there yet
+        if (!DataFile(DATA_FILE).is_open() &&
+            !generate_dataset(DATA_FILE, TRAIN_SIZE + TEST_SIZE, STREAM_ROWS))
+        {
+            std::cout << "Cannot write dataset " << DATA_FILE << "."
+                      << std::endl;
+            std::exit(1);
+        }
+        return;
+    }
+
+    std::vector<Dataset> &sets = DATASETS[data_key()];
+    int n = shared_data()? 1 : THREADS;
+
+    while ((int) sets.size() < n)
+    {
+        sets.emplace_back();
+        Dataset &d = sets.back();
+
+        if (!DATA_FILE.empty() && load_dataset(DATA_FILE, d))
+        {
+            check_shape(d.sigs.rows(), d.sigs.cols(), d.st.cols());
+            continue;
+        }
+
+        generate_data(d.sigs, d.st, TRAIN_SIZE + TEST_SIZE);
+        if (!DATA_FILE.empty() && !save_dataset(DATA_FILE, d))
+            std::cout << "Cannot write dataset " << DATA_FILE
+                      << "; using it unsaved." << std::endl;
+    }
+}
+
 void write(Genome *g, const int tid)
 {
+    if (ELITE_FORMAT == 1)
+    { // The last thread to finish writes the whole run's archive
+        if (ARCHIVE.add(g, ELITES, tid) == THREADS)
+            ARCHIVE.save(FOLDER + "/elites.bin");
+        return;
+    }
+
     for (int i = 0; i < ELITES; i++)
     {
         std::string nameg = FOLDER + "/" + std::to_string(tid) + "_"
@@ -61,64 +274,275 @@ void write(Genome *g, const int tid)
 
 void fork(int tid)
 {
-    MatrixXd sigs, st;
+    pin_worker(tid); // Before the dataset and population are first touched
+
+    MatrixXd own_sigs, own_st;
+    const MatrixXd *sigs = &own_sigs, *st = &own_st;
+    std::unique_ptr<DataFile> file;
+
+    auto sets = DATASETS.find(data_key());
+    if (streaming())
+    {
+        file.reset(new DataFile(DATA_FILE));
+        check_shape(file->rows(), file->cells(), file->targets());
+    }
+    else if (sets != DATASETS.end())
+    {
+        const Dataset &d = sets->second[shared_data()? 0 : tid];
+        sigs = &d.sigs;
+        st = &d.st;
+    }
+    else generate_data(own_sigs, own_st, TRAIN_SIZE + TEST_SIZE);
+    if (DICISION_BOUNDARY != 0 && !file && !multitask())
+        std::cout << geq_prob(*st) << std::endl;
+
+    std::vector<Genome> g(POPULATION);
+    std::vector<Retina> r(POPULATION);
+
+    GA sim(g.data(), r.data());
+    if (file) sim.stream(file.get());
+    sim.run(*sigs, *st, tid);
+
+    write(g.data(), tid);
+
+    std::cout << "[" << tid << "]arena peak "
+              << ARENA.peak() / 1048576.0 << " MB" << std::endl;
+}
+
+void open_db()
+{
+    if (DB_FILE.empty() || FITNESS_DB.open(DB_FILE)) return;
+
+    std::cout << "Cannot open fitness db " << DB_FILE << "." << std::endl;
+    std::exit(1);
+}
+
+// The GA threads of one config
+void run()
+{
+    plan_threads(CORES, THREADS, TRAIN_SIZE + TEST_SIZE, POPULATION);
+    report_threads(std::cout);
+
+    open_db();
+    if (RECORD_GENOMES > 0) RECORDER.open(FOLDER + "/record.bin", RECORD_EVERY);
+
+    std::thread ths[THREADS];
+    for (int i = 0; i < THREADS; i++) ths[i] = std::thread([i]() { fork(i); });
+    for (int i = 0; i < THREADS; i++) ths[i].join();
+    RECORDER.close();
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    std::cout << "peak RSS " << ru.ru_maxrss / 1024 << " MB" << std::endl;
+}
+
+// Daemon mode: genomes sent to SERVE_SOCKET are scored on one dataset,
+// prepared once, by a single GA context with every core
+int serve()
+{
+    if (streaming())
+    {
+        std::cout << "serve needs the dataset in memory; drop stream_rows."
+                  << std::endl;
+        return 1;
+    }
+
+    SHARED_DATA = 1;
+    prepare_datasets();
+    const Dataset &d = DATASETS[data_key()][0];
+
+    plan_threads(CORES, 1, TRAIN_SIZE + TEST_SIZE, POPULATION);
+    report_threads(std::cout);
+    open_db();
+
+    Server server(d.sigs, d.st);
+    if (!server.listen(SERVE_SOCKET))
+    {
+        std::cout << "Cannot listen on " << SERVE_SOCKET << "." << std::endl;
+        return 1;
+    }
+    std::cout << "serving on " << SERVE_SOCKET << std::endl;
+    server.run();
+    return 0;
+}
+
+struct Config
+{
+    std::string name; // Of its param file and output folder
+    int threads, cores;
+    std::string data; // Its data_key()
+};
+
+// Child process of a sweep: one config on its own CPUs
+int run_config(const std::string &folder, const std::vector<int> &cpus,
+               const Options &defaults)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) CPU_SET(c, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+
+    if (!std::freopen((folder + "/stdout").c_str(), "w", stdout)) return 1;
+
+    load_options(defaults);
+    read_param(folder + "/param");
+    FOLDER = folder;
+    CORES = cpus.size();
+    reseed();
+
+    run();
+    return 0;
+}
+
+/*
+ * Every param file of `dir` as one config, with its outputs in
+ * root/<file name>. Configs run as child processes, each on its own
+ * CPUs: one per GA thread (or its `cores` option), and whatever is left
+ * for the last one. Whenever CPUs free up, the largest pending config
+ * that fits starts on them. Datasets are generated once per set of data
+ * parameters, just before the first config that needs one forks, so
+ * that the configs already started run meanwhile, and freed once the
+ * last config that needs it has forked.
+ */
+int sweep(const std::string &root, const std::string &dir)
+{
+    std::vector<std::string> names;
+    DIR *d = opendir(dir.c_str());
+    for (struct dirent *e; d && (e = readdir(d)); )
+    {
+        struct stat st;
+        std::string name = e->d_name;
+        if (stat((dir + "/" + name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            names.push_back(name);
+    }
+    if (d) closedir(d);
+    std::sort(names.begin(), names.end());
 
-    generate(sigs, st, TRAIN_SIZE + TEST_SIZE, 1);
-    if (DICISION_BOUNDARY != 0) std::cout << geq_prob(st) << std::endl;
+    Options defaults = save_options();
+    std::vector<Config> configs;
+    mkdir(root.c_str(), 0755);
 
-    Genome g[POPULATION];
-    Retina r[POPULATION];
+    for (const std::string &name : names)
+    {
+        std::string folder = root + "/" + name;
+        mkdir(folder.c_str(), 0755);
+        {
+            std::ifstream src(dir + "/" + name);
+            std::ofstream dst(folder + "/param");
+            dst << src.rdbuf();
+        }
+
+        load_options(defaults);
+        read_param(folder + "/param");
+        configs.push_back({name, THREADS, CORES, data_key()});
+    }
+
+    std::map<std::string, int> users; // Configs yet to fork, by data_key()
+    for (const Config &c : configs) users[c.data]++;
 
-    GA sim = GA(g, r);
-    sim.run(sigs, st, tid);
+    std::vector<int> cpus = allowed_cpus();
+    std::vector<int> owner(cpus.size(), -1); // Config running on each CPU
+    std::cout << "sweep: " << configs.size() << " configs, "
+              << users.size() << " datasets, " << cpus.size() << " cores"
+              << std::endl;
 
-    write(g, tid);
+    // Largest first; smaller ones fill in the CPUs they leave over
+    std::vector<int> pending(configs.size());
+    for (size_t i = 0; i < pending.size(); i++) pending[i] = i;
+    std::stable_sort(pending.begin(), pending.end(), [&](int a, int b)
+                     { return configs[a].threads > configs[b].threads; });
+
+    std::map<pid_t, int> running;
+    int failed = 0;
+
+    while (!pending.empty() || !running.empty())
+    {
+        int free = std::count(owner.begin(), owner.end(), -1);
+        auto fits = pending.end();
+        int want = 0;
+
+        for (auto p = pending.begin(); p != pending.end(); ++p)
+        {
+            const Config &c = configs[*p];
+            want = (c.cores > 0)? c.cores : c.threads;
+            if (pending.size() == 1 && c.cores == 0)
+                want = std::max(want, free);
+            want = std::max(1, std::min(want, (int) cpus.size()));
+            if (want <= free) { fits = p; break; }
+        }
+
+        if (fits != pending.end())
+        {
+            int i = *fits;
+            pending.erase(fits);
+
+            std::vector<int> mine;
+            for (size_t k = 0; k < cpus.size() && (int) mine.size() < want; k++)
+            {
+                if (owner[k] != -1) continue;
+                owner[k] = i;
+                mine.push_back(cpus[k]);
+            }
+
+            // Its dataset, unless an earlier config made it
+            load_options(defaults);
+            read_param(root + "/" + configs[i].name + "/param");
+            prepare_datasets();
+
+            std::cout << "[" << configs[i].name << "] start on " << want
+                      << " cores" << std::endl;
+            pid_t pid = ::fork();
+            if (pid == 0)
+                std::exit(run_config(root + "/" + configs[i].name, mine,
+                                     defaults));
+
+            running[pid] = i;
+            if (--users[configs[i].data] == 0) DATASETS.erase(configs[i].data);
+            continue;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) break;
+
+        int i = running[pid];
+        running.erase(pid);
+        std::replace(owner.begin(), owner.end(), i, -1);
+
+        bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (!ok) failed++;
+        std::cout << "[" << configs[i].name << "] "
+                  << (ok? "done" : "failed") << std::endl;
+    }
+
+    return failed? 1 : 0;
 }
 
-// Testing main
 int main(int argc, char *argv[])
 {
     if (argc != 3)
     {
-        std::cerr << "./Simulation [folder] [parameters]" << std::endl;
+        std::cerr << "./Simulation [folder] [parameters file or directory]"
+                  << std::endl;
         std::exit(1);
     }
 
+    struct stat st;
+    if (stat(argv[2], &st) == 0 && S_ISDIR(st.st_mode))
+        return sweep(argv[1], argv[2]);
+
     read_param(argv[2]);
+    // test_reading();
+
+    FOLDER = argv[1];
+    if (!SERVE_SOCKET.empty()) return serve();
+    if (shared_data()) prepare_datasets(); // Else each GA thread its own
+    run();
 
-    MatrixXd sigs, st;
-    //
-    // generate(sigs, st, 1, 1);
-    // // std::cout << st.format(TSV) << '\n';
-    // // std::cerr << sigs << '\n';
-    //
-    // int n = 1;
-    //
-    // Genome g[n];
-    // Retina r[n];
-    //
-    // for (int i = 0; i < n; i++)
-    // {
-    //     g[i].r = &r[i];
-    //     g[i].organize();
-    //
-    //     std::cout << g[i].n_types << std::endl;
-    //
-    //     g[i].r->init(g[i]);
-    //     MatrixXd retina_out;
-    //     g[i].r->react(sigs, retina_out, g[i]);
-    //
-    //     std::cerr << retina_out << '\n';
-    //
-    //     // std::cout << *g[i].r << std::endl;
-    //     // std::cout << nn(retina_out, st) << std::endl;
-    // }
-
-    generate(sigs, st, 500, 1);
-    std::cout << nn(sigs, st) << std::endl;
     return 0;
 }
 
+// // Testing main
 // int main(int argc, char *argv[])
 // {
 //     if (argc != 3)
@@ -128,13 +552,36 @@ int main(int argc, char *argv[])
 //     }
 //
 //     read_param(argv[2]);
-//     // test_reading();
-//
-//     FOLDER = argv[1];
 //
-//     std::thread ths[THREADS];
-//     for (int i = 0; i < THREADS; i++) ths[i] = std::thread(fork, i);
-//     for (int i = 0; i < THREADS; i++) ths[i].join();
+//     MatrixXd sigs, st;
+//     //
+//     // generate(sigs, st, 1, 1);
+//     // // std::cout << st.format(TSV) << '\n';
+//     // // std::cerr << sigs << '\n';
+//     //
+//     // int n = 1;
+//     //
+//     // Genome g[n];
+//     // Retina r[n];
+//     //
+//     // for (int i = 0; i < n; i++)
+//     // {
+//     //     g[i].r = &r[i];
+//     //     g[i].organize();
+//     //
+//     //     std::cout << g[i].n_types << std::endl;
+//     //
+//     //     g[i].r->init(g[i]);
+//     //     MatrixXd retina_out;
+//     //     g[i].r->react(sigs, retina_out, g[i]);
+//     //
+//     //     std::cerr << retina_out << '\n';
+//     //
+//     //     // std::cout << *g[i].r << std::endl;
+//     //     // std::cout << nn(retina_out, st) << std::endl;
+//     // }
 //
+//     generate(sigs, st, 500, 1);
+//     std::cout << nn(sigs, st) << std::endl;
 //     return 0;
 // }
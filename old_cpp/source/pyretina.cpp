@@ -0,0 +1,757 @@
+/*
+ * Python module `retina`: the engine without the Simulation binary.
+ *
+ *   import numpy as np, retina
+ *   retina.configure(max_num_cells=100, train_size=900, test_size=100)
+ *   sigs, st = retina.generate_data(1000)
+ *   g = retina.Genome()
+ *   g.init()
+ *   print(retina.readout(g.react(sigs), st))
+ *   best = retina.run(sigs, st)  # The final population, best first
+ *
+ * Matrices cross the boundary without copies: a Fortran-ordered float64
+ * array is read in place through an Eigen map, and results are Eigen
+ * matrices handed to NumPy, so chaining calls never copies. Other arrays
+ * are converted once on the way in (np.asfortranarray avoids it). A
+ * Genome's parameters are arrays viewing the genome itself; react()
+ * refuses a genome changed since its last init(). The GIL is
+ * released while the engine computes, so Python threads can evaluate
+ * genomes in parallel; configure() sets process-wide parameters and is
+ * not to be called while they do.
+ *
+ * configure() takes the param file options that act on the engine and on
+ * run(): fitness_db and db_seed, record as a (genomes, rows, every)
+ * tuple, cores and pin, and data_file streamed stream_rows at a time, in
+ * which case run() takes no x and y. The options of the binary alone
+ * (elite_format, shared_data, serve, serve_wait, trace) are not among
+ * them, and any other name raises KeyError.
+ *
+ * Built by `make python`; the extension lands next to retina_io.py.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#define EIGEN_USE_MKL_ALL
+#include <Eigen/Dense>
+#include "Retina.h"
+#include "tool.h"
+#include "GA.h"
+#include "Threads.h"
+#include "Dataset.h"
+#include "FitnessDB.h"
+#include "Recorder.h"
+
+// Parameters by their param file names
+struct Setting
+{
+    const char *name;
+    int *i;
+    double *d;
+};
+
+static const Setting SETTINGS[] = {
+    {"threads", &THREADS, nullptr},
+    {"max_iterations", &ITERS, nullptr},
+    {"population", &POPULATION, nullptr},
+    {"num_elites", &ELITES, nullptr},
+    {"crossover_rate", nullptr, &XRATE},
+    {"max_num_cells", &CELLS, nullptr},
+    {"sim_time", &T, nullptr},
+    {"tau", nullptr, &TAU},
+    {"eta", nullptr, &ETA},
+    {"epochs", &EPOCHS, nullptr},
+    {"noise_level", nullptr, &NOISE},
+    {"train_size", &TRAIN_SIZE, nullptr},
+    {"test_size", &TEST_SIZE, nullptr},
+    {"label_thre", nullptr, &DICISION_BOUNDARY},
+    {"log_format", &LOG_FORMAT, nullptr},
+    {"eval_parallel", &EVAL_PARALLEL, nullptr},
+    {"react_tol", nullptr, &REACT_TOL},
+    {"react_k", &REACT_K, nullptr},
+    {"react_check", &REACT_CHECK, nullptr},
+    {"react_batch", &REACT_BATCH, nullptr},
+    {"cores", &CORES, nullptr},
+    {"pin", &PIN, nullptr},
+    {"stream_rows", &STREAM_ROWS, nullptr},
+    {"db_seed", &DB_SEED, nullptr},
+    {"refresh", &REFRESH, nullptr},
+    {"refresh_frac", nullptr, &REFRESH_FRAC},
+    {"mosaic", &MOSAIC, nullptr},
+    {"pareto", &PARETO, nullptr},
+    {"cmaes", &CMAES_EVERY, nullptr},
+    {"cmaes_elites", &CMAES_ELITES, nullptr},
+    {"cmaes_iters", &CMAES_ITERS, nullptr},
+    {"cmaes_lambda", &CMAES_LAMBDA, nullptr},
+    {"niche", &NICHE, nullptr},
+    {"niche_radius", nullptr, &NICHE_RADIUS},
+    {"surrogate", nullptr, &SURROGATE},
+    {"surrogate_explore", nullptr, &SURROGATE_EXPLORE},
+};
+
+// The three-weight options
+static Eigen::Matrix<double, 3, 1> *weights(const std::string &name)
+{
+    if (name == "w_cost") return &W_COST;
+    if (name == "tasks") return &W_TASKS;
+    return nullptr;
+}
+
+// The file name options
+static std::string *path(const std::string &name)
+{
+    if (name == "data_file") return &DATA_FILE;
+    if (name == "fitness_db") return &DB_FILE;
+    return nullptr;
+}
+
+/*
+ * Matrices
+ */
+
+// obj as a Fortran-ordered float64 array of at most 2 dimensions; obj
+// itself when it already is one. New reference, or null with an error.
+static PyArrayObject *as_matrix(PyObject *obj)
+{
+    PyArrayObject *a = (PyArrayObject *) PyArray_FROM_OTF(obj, NPY_DOUBLE,
+                                                          NPY_ARRAY_IN_FARRAY);
+    if (a && PyArray_NDIM(a) > 2)
+    {
+        Py_DECREF(a);
+        PyErr_SetString(PyExc_ValueError, "expected a 1-D or 2-D array");
+        return nullptr;
+    }
+    return a;
+}
+
+// The buffer of an as_matrix() array; 1-D arrays are columns
+static Eigen::Map<const MatrixXd> view(PyArrayObject *a)
+{
+    npy_intp r = (PyArray_NDIM(a) > 0)? PyArray_DIM(a, 0) : 1;
+    npy_intp c = (PyArray_NDIM(a) > 1)? PyArray_DIM(a, 1) : 1;
+    return Eigen::Map<const MatrixXd>((const double *) PyArray_DATA(a), r, c);
+}
+
+static void free_matrix(PyObject *capsule)
+{
+    delete (MatrixXd *) PyCapsule_GetPointer(capsule, "retina.matrix");
+}
+
+// m's buffer as an array that owns it
+static PyObject *to_array(MatrixXd &&m)
+{
+    MatrixXd *owned = new MatrixXd(std::move(m));
+    npy_intp dims[2] = {owned->rows(), owned->cols()};
+    PyObject *a = PyArray_New(&PyArray_Type, 2, dims, NPY_DOUBLE, nullptr,
+                              owned->data(), 0, NPY_ARRAY_FARRAY, nullptr);
+    PyObject *capsule = a? PyCapsule_New(owned, "retina.matrix", free_matrix)
+                         : nullptr;
+    if (!capsule)
+    {
+        Py_XDECREF(a);
+        delete owned;
+        return nullptr;
+    }
+    PyArray_SetBaseObject((PyArrayObject *) a, capsule); // Steals capsule
+    return a;
+}
+
+/*
+ * Genome
+ */
+
+struct PyGenome
+{
+    PyObject_HEAD
+    Genome *g;
+    Retina *r; // Of g, built by init()
+    Genome *built; // The parameters r was built from
+};
+
+static PyTypeObject *GenomeType; // Made by PyInit_retina()
+
+// A Python genome owning g and r
+static PyObject *wrap(Genome *g, Retina *r)
+{
+    PyGenome *self = PyObject_New(PyGenome, GenomeType);
+    if (!self)
+    {
+        delete g;
+        delete r;
+        return nullptr;
+    }
+    self->g = g;
+    self->r = r;
+    self->built = new Genome(*g); // r is g's unless g is dirty
+    g->r = r;
+    return (PyObject *) self;
+}
+
+static PyObject *genome_new(PyTypeObject *, PyObject *args, PyObject *kw)
+{
+    static const char *kwlist[] = {nullptr};
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "", (char **) kwlist))
+        return nullptr;
+    return wrap(new Genome(), new Retina());
+}
+
+static void genome_dealloc(PyGenome *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    delete self->g;
+    delete self->r;
+    delete self->built;
+    PyObject_Free(self);
+    Py_DECREF(type);
+}
+
+static PyObject *genome_repr(PyGenome *self)
+{
+    std::ostringstream s;
+    s << *self->g;
+    return PyUnicode_FromString(s.str().c_str());
+}
+
+static PyObject *genome_organize(PyGenome *self, PyObject *)
+{
+    self->g->organize();
+    Py_RETURN_NONE;
+}
+
+// Builds the retina from scratch, since the parameter arrays are written
+// without Genome::dirty knowing
+static PyObject *genome_init(PyGenome *self, PyObject *)
+{
+    Genome *g = self->g;
+    Py_BEGIN_ALLOW_THREADS
+    g->organize();
+    g->dirty = ALL_LAYERS;
+    g->r->init(*g);
+    Py_END_ALLOW_THREADS
+    *self->built = *g;
+    Py_RETURN_NONE;
+}
+
+// Whether g still has the parameters of b, which its retina was built from;
+// the arrays change them in place
+static bool unchanged(const Genome &g, const Genome &b)
+{
+    int n = g.n_types;
+    return n == b.n_types && g.th == b.th &&
+           std::equal(g.n_cell, g.n_cell + n, b.n_cell) &&
+           std::equal(g.axon, g.axon + n, b.axon) &&
+           std::equal(g.dendrite, g.dendrite + n, b.dendrite) &&
+           std::equal(g.phi, g.phi + n, b.phi) &&
+           std::equal(g.beta, g.beta + n, b.beta) &&
+           std::equal(g.resistance, g.resistance + n, b.resistance);
+}
+
+// Ganglion cell responses to the rows of x, after init()
+static PyObject *genome_react(PyGenome *self, PyObject *args, PyObject *kw)
+{
+    static const char *kwlist[] = {"x", "threads", nullptr};
+    PyObject *obj;
+    int threads = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "O|i", (char **) kwlist,
+                                     &obj, &threads))
+        return nullptr;
+    if (self->g->dirty || !unchanged(*self->g, *self->built))
+    {
+        PyErr_SetString(PyExc_RuntimeError,
+                        "init() the genome after changing it");
+        return nullptr;
+    }
+
+    PyArrayObject *a = as_matrix(obj);
+    if (!a) return nullptr;
+    Eigen::Map<const MatrixXd> x = view(a);
+    if (x.cols() != CELLS)
+    {
+        Py_DECREF(a);
+        return PyErr_Format(PyExc_ValueError, "x has %ld columns, not "
+                            "max_num_cells %d", (long) x.cols(), CELLS);
+    }
+
+    MatrixXd out;
+    Genome *g = self->g;
+    Py_BEGIN_ALLOW_THREADS
+    g->r->react(x, out, *g, threads);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(a);
+    return to_array(std::move(out));
+}
+
+static PyMethodDef genome_methods[] = {
+    {"organize", (PyCFunction) genome_organize, METH_NOARGS,
+     "Lays the cell types out; init() does it too."},
+    {"init", (PyCFunction) genome_init, METH_NOARGS,
+     "Builds the retina of the genome."},
+    {"react", (PyCFunction) (void (*)(void)) genome_react,
+     METH_VARARGS | METH_KEYWORDS,
+     "react(x, threads=1): ganglion cell responses to the rows of x."},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+// Parameter arrays of the n_types layers, viewing the genome
+static PyObject *genome_array(PyGenome *self, void *field, const int type)
+{
+    npy_intp n = self->g->n_types;
+    PyObject *a = PyArray_New(&PyArray_Type, 1, &n, type, nullptr, field, 0,
+                              NPY_ARRAY_CARRAY, nullptr);
+    if (!a) return nullptr;
+    Py_INCREF(self);
+    PyArray_SetBaseObject((PyArrayObject *) a, (PyObject *) self);
+    return a;
+}
+
+#define GENOME_ARRAY(name, type) \
+    static PyObject *get_##name(PyGenome *self, void *) \
+    { \
+        return genome_array(self, self->g->name, type); \
+    }
+
+GENOME_ARRAY(n_cell, NPY_INT)
+GENOME_ARRAY(axon, NPY_DOUBLE)
+GENOME_ARRAY(dendrite, NPY_DOUBLE)
+GENOME_ARRAY(phi, NPY_DOUBLE)
+GENOME_ARRAY(beta, NPY_DOUBLE)
+GENOME_ARRAY(resistance, NPY_DOUBLE)
+
+static PyObject *get_n_types(PyGenome *self, void *)
+{
+    return PyLong_FromLong(self->g->n_types);
+}
+
+static int set_n_types(PyGenome *self, PyObject *v, void *)
+{
+    long n = v? PyLong_AsLong(v) : -1;
+    if (n == -1 && PyErr_Occurred()) return -1;
+    if (n < 2 || n > MAX_TYPES)
+    {
+        PyErr_Format(PyExc_ValueError, "n_types is in [2, %d]", MAX_TYPES);
+        return -1;
+    }
+    self->g->n_types = n;
+    self->g->dirty = ALL_LAYERS;
+    return 0;
+}
+
+static PyObject *get_th(PyGenome *self, void *)
+{
+    return PyFloat_FromDouble(self->g->th);
+}
+
+static int set_th(PyGenome *self, PyObject *v, void *)
+{
+    double th = v? PyFloat_AsDouble(v) : -1;
+    if (th == -1 && PyErr_Occurred()) return -1;
+    self->g->th = th;
+    self->g->dirty = ALL_LAYERS;
+    return 0;
+}
+
+static PyObject *get_fit_cost(PyGenome *self, void *)
+{
+    return PyFloat_FromDouble(self->g->fit_cost);
+}
+
+static PyObject *get_total_cost(PyGenome *self, void *)
+{
+    return PyFloat_FromDouble(self->g->total_cost);
+}
+
+static PyObject *get_n_synapses(PyGenome *self, void *)
+{
+    return PyLong_FromLong(self->g->n_synapses);
+}
+
+static PyGetSetDef genome_getset[] = {
+    {"n_types", (getter) get_n_types, (setter) set_n_types, nullptr, nullptr},
+    {"n_cell", (getter) get_n_cell, nullptr, nullptr, nullptr},
+    {"axon", (getter) get_axon, nullptr, nullptr, nullptr},
+    {"dendrite", (getter) get_dendrite, nullptr, nullptr, nullptr},
+    {"phi", (getter) get_phi, nullptr, nullptr, nullptr},
+    {"beta", (getter) get_beta, nullptr, nullptr, nullptr},
+    {"resistance", (getter) get_resistance, nullptr, nullptr, nullptr},
+    {"th", (getter) get_th, (setter) set_th, nullptr, nullptr},
+    {"fit_cost", (getter) get_fit_cost, nullptr, nullptr, nullptr},
+    {"total_cost", (getter) get_total_cost, nullptr, nullptr, nullptr},
+    {"n_synapses", (getter) get_n_synapses, nullptr, nullptr, nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}
+};
+
+/*
+ * Module functions
+ */
+
+static PyObject *configure(PyObject *, PyObject *args, PyObject *kw)
+{
+    if (PyTuple_Size(args) > 0)
+    {
+        PyErr_SetString(PyExc_TypeError, "configure() takes keywords only");
+        return nullptr;
+    }
+
+    PyObject *key, *v;
+    Py_ssize_t pos = 0;
+    while (kw && PyDict_Next(kw, &pos, &key, &v))
+    {
+        std::string name = PyUnicode_AsUTF8(key);
+
+        if (Eigen::Matrix<double, 3, 1> *w = weights(name))
+        {
+            double a, b, c;
+            if (!PyArg_ParseTuple(v, "ddd", &a, &b, &c)) return nullptr;
+            *w << a, b, c;
+            continue;
+        }
+
+        if (std::string *f = path(name))
+        {
+            const char *c = PyUnicode_AsUTF8(v);
+            if (!c) return nullptr;
+            *f = c;
+            continue;
+        }
+
+        if (name == "record")
+        {
+            if (!PyArg_ParseTuple(v, "iii", &RECORD_GENOMES, &RECORD_ROWS,
+                                  &RECORD_EVERY))
+                return nullptr;
+            continue;
+        }
+
+        const Setting *s = nullptr;
+        for (const Setting &t : SETTINGS)
+            if (name == t.name) s = &t;
+        if (!s)
+            return PyErr_Format(PyExc_KeyError, "no parameter %s",
+                                name.c_str());
+
+        if (s->i) *s->i = PyLong_AsLong(v);
+        else *s->d = PyFloat_AsDouble(v);
+        if (PyErr_Occurred()) return nullptr;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *config(PyObject *, PyObject *)
+{
+    PyObject *d = PyDict_New();
+    if (!d) return nullptr;
+    for (const Setting &s : SETTINGS)
+    {
+        PyObject *v = s.i? PyLong_FromLong(*s.i) : PyFloat_FromDouble(*s.d);
+        PyDict_SetItemString(d, s.name, v);
+        Py_XDECREF(v);
+    }
+    for (const char *name : {"w_cost", "tasks"})
+    {
+        const Eigen::Matrix<double, 3, 1> &w = *weights(name);
+        PyObject *v = Py_BuildValue("(ddd)", w(0), w(1), w(2));
+        PyDict_SetItemString(d, name, v);
+        Py_XDECREF(v);
+    }
+    for (const char *name : {"data_file", "fitness_db"})
+    {
+        PyObject *v = PyUnicode_FromString(path(name)->c_str());
+        PyDict_SetItemString(d, name, v);
+        Py_XDECREF(v);
+    }
+    PyObject *v = Py_BuildValue("(iii)", RECORD_GENOMES, RECORD_ROWS,
+                                RECORD_EVERY);
+    PyDict_SetItemString(d, "record", v);
+    Py_XDECREF(v);
+    return d;
+}
+
+static PyObject *py_generate(PyObject *, PyObject *args, PyObject *kw)
+{
+    static const char *kwlist[] = {"n", "num_sigs", nullptr};
+    int n, num_sigs = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "i|i", (char **) kwlist,
+                                     &n, &num_sigs))
+        return nullptr;
+
+    MatrixXd sigs, st;
+    Py_BEGIN_ALLOW_THREADS
+    generate(sigs, st, n, num_sigs);
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("(NN)", to_array(std::move(sigs)),
+                         to_array(std::move(st)));
+}
+
+static PyObject *py_generate_data(PyObject *, PyObject *args)
+{
+    int n;
+    if (!PyArg_ParseTuple(args, "i", &n)) return nullptr;
+
+    MatrixXd sigs, y;
+    Py_BEGIN_ALLOW_THREADS
+    generate_data(sigs, y, n);
+    Py_END_ALLOW_THREADS
+    return Py_BuildValue("(NN)", to_array(std::move(sigs)),
+                         to_array(std::move(y)));
+}
+
+// Both as matrices of as many rows, or null with an error
+static bool as_pair(PyObject *ox, PyObject *oy, PyArrayObject *&x,
+                    PyArrayObject *&y)
+{
+    x = as_matrix(ox);
+    y = x? as_matrix(oy) : nullptr;
+    if (y && view(x).rows() == view(y).rows()) return true;
+
+    if (y) PyErr_SetString(PyExc_ValueError, "x and y differ in rows");
+    Py_XDECREF(x);
+    Py_XDECREF(y);
+    return false;
+}
+
+static PyObject *py_nn(PyObject *, PyObject *args, PyObject *kw)
+{
+    static const char *kwlist[] = {"x", "y", "threads", "bce", nullptr};
+    PyObject *ox, *oy;
+    int threads = 1, bce = DICISION_BOUNDARY != 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "OO|ip", (char **) kwlist,
+                                     &ox, &oy, &threads, &bce))
+        return nullptr;
+
+    PyArrayObject *x, *y;
+    if (!as_pair(ox, oy, x, y)) return nullptr;
+
+    double loss;
+    Py_BEGIN_ALLOW_THREADS
+    loss = nn(view(x), view(y), threads, bce);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(x);
+    Py_DECREF(y);
+    return PyFloat_FromDouble(loss);
+}
+
+static PyObject *py_readout(PyObject *, PyObject *args, PyObject *kw)
+{
+    static const char *kwlist[] = {"x", "y", "threads", nullptr};
+    PyObject *ox, *oy;
+    int threads = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "OO|i", (char **) kwlist,
+                                     &ox, &oy, &threads))
+        return nullptr;
+
+    PyArrayObject *x, *y;
+    if (!as_pair(ox, oy, x, y)) return nullptr;
+
+    double loss;
+    Py_BEGIN_ALLOW_THREADS
+    loss = readout(view(x), view(y), threads);
+    Py_END_ALLOW_THREADS
+    Py_DECREF(x);
+    Py_DECREF(y);
+    return PyFloat_FromDouble(loss);
+}
+
+static PyObject *py_decoder(PyObject *, PyObject *args)
+{
+    PyObject *orr, *ox, *ox0;
+    if (!PyArg_ParseTuple(args, "OOO", &orr, &ox, &ox0)) return nullptr;
+
+    PyArrayObject *r, *x, *x0 = nullptr;
+    if (!as_pair(orr, ox, r, x)) return nullptr;
+    x0 = as_matrix(ox0);
+    if (x0 && view(x0).rows() != view(r).cols())
+    {
+        PyErr_SetString(PyExc_ValueError, "x0 needs a row per column of r");
+        Py_CLEAR(x0);
+    }
+
+    double loss = 0;
+    if (x0)
+    {
+        Py_BEGIN_ALLOW_THREADS
+        loss = decoder(view(r), view(x), view(x0));
+        Py_END_ALLOW_THREADS
+    }
+    Py_DECREF(r);
+    Py_DECREF(x);
+    if (!x0) return nullptr;
+    Py_DECREF(x0);
+    return PyFloat_FromDouble(loss);
+}
+
+// A whole GA on x and y, logged to folder; its final population, best first
+// data_file, written first if it is not there, when run() streams it
+static DataFile *open_stream()
+{
+    if (multitask())
+    {
+        PyErr_SetString(PyExc_ValueError, "tasks needs the dataset in "
+                        "memory; drop stream_rows");
+        return nullptr;
+    }
+
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = DataFile(DATA_FILE).is_open() ||
+         generate_dataset(DATA_FILE, TRAIN_SIZE + TEST_SIZE, STREAM_ROWS);
+    Py_END_ALLOW_THREADS
+    if (!ok)
+    {
+        PyErr_Format(PyExc_OSError, "cannot write dataset %s",
+                     DATA_FILE.c_str());
+        return nullptr;
+    }
+
+    DataFile *file = new DataFile(DATA_FILE);
+    if (file->cells() != CELLS || file->rows() != TRAIN_SIZE + TEST_SIZE ||
+        file->targets() != ((DICISION_BOUNDARY != 0)? 1 : 2))
+    {
+        delete file;
+        PyErr_Format(PyExc_ValueError, "%s is not train_size + test_size x "
+                     "max_num_cells with the targets of label_thre",
+                     DATA_FILE.c_str());
+        return nullptr;
+    }
+    return file;
+}
+
+static PyObject *py_run(PyObject *, PyObject *args, PyObject *kw)
+{
+    static const char *kwlist[] = {"x", "y", "folder", "tid", nullptr};
+    PyObject *ox = Py_None, *oy = Py_None;
+    const char *folder = ".";
+    int tid = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|OOsi", (char **) kwlist,
+                                     &ox, &oy, &folder, &tid))
+        return nullptr;
+
+    std::unique_ptr<DataFile> file;
+    PyArrayObject *x = nullptr, *y = nullptr;
+    if (STREAM_ROWS > 0 && !DATA_FILE.empty())
+    {
+        file.reset(open_stream());
+        if (!file) return nullptr;
+    }
+    else if (ox == Py_None || oy == Py_None)
+        return PyErr_Format(PyExc_TypeError, "run() needs x and y unless "
+                            "data_file is streamed");
+    else if (!as_pair(ox, oy, x, y)) return nullptr;
+    else if (view(x).cols() != CELLS ||
+             view(x).rows() != TRAIN_SIZE + TEST_SIZE)
+    {
+        Py_DECREF(x);
+        Py_DECREF(y);
+        return PyErr_Format(PyExc_ValueError, "x is not train_size + "
+                            "test_size x max_num_cells");
+    }
+
+    // As the binary does for each config, with this the one GA thread
+    FOLDER = folder;
+    plan_threads(CORES, 1, TRAIN_SIZE + TEST_SIZE, POPULATION);
+    if (DB_FILE.empty()) FITNESS_DB.close();
+    else if (!FITNESS_DB.open(DB_FILE))
+        PyErr_Format(PyExc_OSError, "cannot open fitness db %s",
+                     DB_FILE.c_str());
+    if (!PyErr_Occurred() && RECORD_GENOMES > 0 &&
+        !RECORDER.open(FOLDER + "/record.bin", RECORD_EVERY))
+        PyErr_Format(PyExc_OSError, "cannot open %s/record.bin", folder);
+    if (PyErr_Occurred())
+    {
+        Py_XDECREF(x);
+        Py_XDECREF(y);
+        return nullptr;
+    }
+
+    std::vector<Genome> g(POPULATION);
+    std::vector<Retina> r(POPULATION);
+    Py_BEGIN_ALLOW_THREADS
+    pin_worker(0);
+    { // The GA's stimuli are its own, so it is run on a copy
+        MatrixXd sigs, st;
+        if (x)
+        {
+            sigs = view(x);
+            st = view(y);
+        }
+        GA sim(g.data(), r.data());
+        if (file) sim.stream(file.get());
+        sim.run(sigs, st, tid);
+    }
+    RECORDER.close();
+    Py_END_ALLOW_THREADS
+    Py_XDECREF(x);
+    Py_XDECREF(y);
+
+    // Ranking moved the genomes but not the retinas, so each takes the one
+    // it points to
+    PyObject *pop = PyList_New(POPULATION);
+    for (int i = 0; pop && i < POPULATION; i++)
+    {
+        PyObject *o = wrap(new Genome(g[i]), new Retina(std::move(*g[i].r)));
+        if (!o) Py_CLEAR(pop);
+        else PyList_SET_ITEM(pop, i, o);
+    }
+    return pop;
+}
+
+static PyMethodDef methods[] = {
+    {"configure", (PyCFunction) (void (*)(void)) configure,
+     METH_VARARGS | METH_KEYWORDS,
+     "configure(**params): sets parameters by their param file names."},
+    {"config", config, METH_NOARGS, "The parameters configure() sets."},
+    {"generate", (PyCFunction) (void (*)(void)) py_generate,
+     METH_VARARGS | METH_KEYWORDS,
+     "generate(n, num_sigs=1): n stimuli and their bounds."},
+    {"generate_data", py_generate_data, METH_VARARGS,
+     "generate_data(n): n stimuli and the targets of the configured tasks."},
+    {"nn", (PyCFunction) (void (*)(void)) py_nn, METH_VARARGS | METH_KEYWORDS,
+     "nn(x, y, threads=1, bce=label_thre != 0): test loss of the readout."},
+    {"readout", (PyCFunction) (void (*)(void)) py_readout,
+     METH_VARARGS | METH_KEYWORDS,
+     "readout(x, y, threads=1): weighted loss of the configured tasks."},
+    {"decoder", py_decoder, METH_VARARGS,
+     "decoder(r, x, x0): squared error of the centre decoded from r."},
+    {"run", (PyCFunction) (void (*)(void)) py_run,
+     METH_VARARGS | METH_KEYWORDS,
+     "run(x, y, folder='.', tid=0): the final population of a GA run, best "
+     "first. Its log goes to folder and its progress to stdout; x and y are "
+     "left out when data_file is streamed."},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "retina", "The retina simulation engine.", -1,
+    methods, nullptr, nullptr, nullptr, nullptr
+};
+
+PyMODINIT_FUNC PyInit_retina()
+{
+    import_array();
+
+    static PyType_Slot slots[] = {
+        {Py_tp_doc, (void *) "A random genome of the configured max_num_cells."},
+        {Py_tp_new, (void *) genome_new},
+        {Py_tp_dealloc, (void *) genome_dealloc},
+        {Py_tp_repr, (void *) genome_repr},
+        {Py_tp_methods, genome_methods},
+        {Py_tp_getset, genome_getset},
+        {0, nullptr}
+    };
+    static PyType_Spec spec = {"retina.Genome", sizeof(PyGenome), 0,
+                               Py_TPFLAGS_DEFAULT, slots};
+
+    GenomeType = (PyTypeObject *) PyType_FromSpec(&spec);
+    PyObject *m = GenomeType? PyModule_Create(&module) : nullptr;
+    if (!m) return nullptr;
+    if (PyModule_AddObject(m, "Genome", (PyObject *) GenomeType) < 0)
+    { // GenomeType is kept for wrap()
+        Py_DECREF(m);
+        return nullptr;
+    }
+    Py_INCREF(GenomeType); // The module's, besides wrap()'s
+    return m;
+}
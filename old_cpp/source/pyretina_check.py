@@ -0,0 +1,63 @@
+#! /usr/bin/env python3
+"""Checks of the retina module that its C++ side cannot make alone.
+
+    make python && ./pyretina_check.py
+"""
+import sys
+import retina
+
+
+def raises(f):
+    try:
+        f()
+    except RuntimeError:
+        return True
+    return False
+
+
+def main():
+    retina.configure(max_num_cells=40, train_size=50, test_size=10)
+    sigs, _ = retina.generate_data(60)
+    failed = []
+
+    g = retina.Genome()
+    if not raises(lambda: g.react(sigs)):
+        failed.append('react before init()')
+
+    # Each edit leaves the built retina stale until init() again
+    edits = {'th': lambda: setattr(g, 'th', 0.9),
+             'beta': lambda: g.beta.__setitem__(0, g.beta[0] + 0.01),
+             'n_types': lambda: setattr(g, 'n_types', g.n_types)}
+    for name, edit in edits.items():
+        g.init()
+        g.react(sigs)
+        edit()
+        if not raises(lambda: g.react(sigs)):
+            failed.append('react after setting ' + name)
+        g.init()
+        g.react(sigs)
+
+    # Every option configure() takes is reported back; others are refused
+    options = {'cores': 2, 'pin': 1, 'stream_rows': 16, 'db_seed': 3,
+               'data_file': 'x.bin', 'fitness_db': 'x.db',
+               'record': (1, 2, 3)}
+    saved = {k: v for k, v in retina.config().items() if k in options}
+    retina.configure(**options)
+    for k, v in options.items():
+        if retina.config()[k] != v:
+            failed.append('configure(%s=%r)' % (k, v))
+    retina.configure(**saved)
+    try:
+        retina.configure(serve='x.sock')
+        failed.append('configure(serve=...)')
+    except KeyError:
+        pass
+
+    for f in failed:
+        print('not refused:', f)
+    print('python: %d failed' % len(failed))
+    return len(failed) > 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
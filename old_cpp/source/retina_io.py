@@ -0,0 +1,286 @@
+#! /usr/bin/env python3
+"""Readers for the binary outputs of Simulation (logs, elite archives,
+fitness databases, recorded dynamics), and a client of its serve mode.
+
+    ./retina_io.py log2tsv [log.bin] [log.tsv]
+"""
+import sys
+import os
+import struct
+import socket
+import zlib
+import numpy as np
+
+LOG_FIELDS = ('fit_cost', 'n_synapses', 'i2e')
+
+def read_log(fname):
+    """Read a generation log into an array of (generation, genome, field)."""
+    if fname.endswith('.tsv'):
+        with open(fname, 'r') as f: # generations are separated by blank lines
+            blocks = [b for b in f.read().split('\n\n') if b.strip()]
+        return np.stack([np.array([l.split() for l in b.splitlines()
+                                   if not l.startswith('#')],
+                                  dtype=np.float64) for b in blocks], axis=0)
+
+    return np.stack([block for block, model, react, prof in log_blocks(fname)],
+                    axis=0)
+
+PHASES = ('organize', 'init', 'react', 'nn_train', 'nn_test', 'rank',
+          'select', 'crossover', 'mutate', 'log', 'niche') + \
+         tuple('react_layer%d' % i for i in range(7))
+
+def read_profile(fname):
+    """Per-generation phase profile of a log written by a PROFILE build,
+    as an array of (generation, phase, [seconds, calls, bytes])."""
+    profs = [prof for block, model, react, prof in log_blocks(fname)]
+    if profs[0] is None:
+        raise ValueError('%s has no profile; build with make profile' % fname)
+    return np.stack(profs, axis=0)
+
+def read_model(fname):
+    """Per-generation accuracy of the surrogate in a log of a surrogate run,
+    as an array of (generation, [children checked, mae, corr])."""
+    if fname.endswith('.tsv'):
+        with open(fname, 'r') as f:
+            rows = [l.split()[1:] for l in f if l.startswith('#model')]
+    else:
+        rows = [model for block, model, react, prof in log_blocks(fname)]
+    if not rows or rows[0] is None:
+        raise ValueError('%s has no surrogate stats' % fname)
+    return np.array(rows, dtype=np.float64)
+
+def read_react(fname):
+    """The react_check samples of a log, as an array of (bound, error)
+    rows with the generation of each in a first column."""
+    if fname.endswith('.tsv'):
+        with open(fname, 'r') as f:
+            blocks = [b for b in f.read().split('\n\n') if b.strip()]
+        rows = [[gen] + l.split()[1:] for gen, b in enumerate(blocks)
+                for l in b.splitlines() if l.startswith('#react')]
+    else:
+        blocks = [react for block, model, react, prof in log_blocks(fname)]
+        if blocks and blocks[0] is None:
+            raise ValueError('%s has no react checks' % fname)
+        rows = [[gen, bound, error] for gen, react in enumerate(blocks)
+                for bound, error in react]
+    return np.array(rows, dtype=np.float64).reshape(-1, 3)
+
+def log_blocks(fname):
+    """Yield (stats of one generation, the surrogate's (n, mae, corr) or
+    None, its react checks as (bound, error) rows or None, its phase
+    profile or None)."""
+    with open(fname, 'rb') as f:
+        if f.read(4) != b'RLOG':
+            raise ValueError('%s is not a generation log' % fname)
+        version, tid, n_fields, flags = struct.unpack('<4I', f.read(16))
+
+        while True:
+            hdr = f.read(24)
+            if len(hdr) < 24:
+                break
+            gen, n, raw_bytes, stored_bytes = struct.unpack('<2i2Q', hdr)
+            payload = f.read(stored_bytes)
+            if flags & 1 and stored_bytes != raw_bytes:
+                payload = zlib.decompress(payload)
+
+            block = np.empty((n, n_fields), dtype=np.float64)
+            block[:, 0] = np.frombuffer(payload, '<f8', n, 0)
+            block[:, 1] = np.frombuffer(payload, '<i4', n, 8 * n)
+            block[:, 2] = np.frombuffer(payload, '<f8', n, 12 * n)
+
+            model = None
+            if flags & 4:
+                model = struct.unpack('<i2d', f.read(20))
+
+            react = None
+            if flags & 8:
+                k, = struct.unpack('<i', f.read(4))
+                raw = f.read(16 * k)
+                react = np.stack([np.frombuffer(raw, '<f8', k, 0),
+                                  np.frombuffer(raw, '<f8', k, 8 * k)], axis=1)
+
+            prof = None
+            if flags & 2:
+                n_phases, = struct.unpack('<I', f.read(4))
+                raw = f.read(24 * n_phases)
+                prof = np.stack([np.frombuffer(raw, '<f8', n_phases, 0),
+                                 np.frombuffer(raw, '<i8', n_phases, 8 * n_phases),
+                                 np.frombuffer(raw, '<i8', n_phases, 16 * n_phases)],
+                                axis=1).astype(np.float64)
+            yield block, model, react, prof
+
+def find_log(path, tid):
+    """Path of thread tid's log, preferring the binary format."""
+    for ext in ('.bin', '.tsv'):
+        fname = os.path.join(path, 'log%d%s' % (tid, ext))
+        if os.path.exists(fname):
+            return fname
+    raise FileNotFoundError(os.path.join(path, 'log%d' % tid))
+
+INDEX_DTYPE = np.dtype([('tid', '<i4'), ('rank', '<i4'),
+                        ('offset', '<u8'), ('blob_bytes', '<u8')])
+
+def genome_dtype(max_types):
+    return np.dtype([('n_types', '<i4'), ('n_synapses', '<i4'),
+                     ('n_cell', '<i4', max_types), ('pad', '<i4'),
+                     ('th', '<f8'), ('fit_cost', '<f8'), ('i2e', '<f8'),
+                     ('total_cost', '<f8'),
+                     ('axon', '<f8', max_types), ('dendrite', '<f8', max_types),
+                     ('phi', '<f8', max_types), ('beta', '<f8', max_types),
+                     ('resistance', '<f8', max_types),
+                     ('intvl', '<f8', max_types)])
+
+class Archive:
+    """Random access to an elites.bin archive without reading all of it.
+
+    index: structured array of (tid, rank, offset, blob_bytes)
+    a[k]:  (genome record, {(from, to): weight matrix}) of the k-th elite
+    """
+    def __init__(self, fname):
+        self.buf = np.memmap(fname, dtype=np.uint8, mode='r')
+        if bytes(self.buf[:4]) != b'RARC':
+            raise ValueError('%s is not an elite archive' % fname)
+        version, n, max_types = np.frombuffer(self.buf, '<u4', 3, 4)
+        self.index = np.frombuffer(self.buf, INDEX_DTYPE, n, 16)
+        self.genome = genome_dtype(max_types)
+
+    def __len__(self):
+        return len(self.index)
+
+    def find(self, tid, rank):
+        return int(np.flatnonzero((self.index['tid'] == tid) &
+                                  (self.index['rank'] == rank))[0])
+
+    def __getitem__(self, k):
+        off = int(self.index['offset'][k])
+        g = np.frombuffer(self.buf, self.genome, 1, off)[0]
+
+        off += self.genome.itemsize
+        n_edges = int(np.frombuffer(self.buf, '<u4', 1, off)[0])
+        off += 4
+        w = {}
+        for _ in range(n_edges):
+            i, j, rows, cols = np.frombuffer(self.buf, '<i4', 4, off)
+            off += 16
+            w[(int(i), int(j))] = np.frombuffer(self.buf, '<f8', rows * cols,
+                                                off).reshape(cols, rows).T
+            off += 8 * rows * cols
+        return g, w
+
+def read_archive(fname):
+    """All elites of an archive as a list of (genome, weights)."""
+    a = Archive(fname)
+    return [a[k] for k in range(len(a))]
+
+def fitness_dtype(max_types):
+    return np.dtype([('genome', '<u8'), ('data', '<u8'), ('config', '<u8'),
+                     ('fit_cost', '<f8'), ('n_synapses', '<i4'),
+                     ('seconds', '<f4'), ('g', genome_dtype(max_types))])
+
+def read_fitness_db(fname):
+    """Every record of a fitness_db log as a structured array, mapped."""
+    with open(fname, 'rb') as f:
+        head = f.read(16)
+    if head[:4] != b'RFDB':
+        raise ValueError('%s is not a fitness db' % fname)
+    version, record_bytes, max_types = struct.unpack('<3I', head[4:])
+    dtype = fitness_dtype(max_types)
+    if dtype.itemsize != record_bytes:
+        raise ValueError('%s has %d-byte records' % (fname, record_bytes))
+    n = (os.path.getsize(fname) - 16) // record_bytes
+    return np.memmap(fname, dtype=dtype, mode='r', offset=16, shape=(n,))
+
+EVENT_DTYPE = np.dtype([('kind', '<u2'), ('layer', '<u2'), ('source', '<u4'),
+                        ('row', '<u4'), ('t', '<u4'), ('n', '<u4')])
+
+def read_record(fname):
+    """Events of a record.bin as (spikes, states).
+
+    spikes: structured array of (source, row, t, cell), one per spike
+    states: {(source, layer, row): (t[k], potentials[k, cells])}
+    source is tid * 65536 + rank.
+    """
+    buf = np.fromfile(fname, dtype=np.uint8)
+    if bytes(buf[:4]) != b'RREC':
+        raise ValueError('%s is not a recording' % fname)
+    spikes, states = [], {}
+    off = 16
+    while off < len(buf):
+        ev = np.frombuffer(buf, EVENT_DTYPE, 1, off)[0]
+        off += EVENT_DTYPE.itemsize
+        n = int(ev['n'])
+        key = (int(ev['source']), int(ev['row']), int(ev['t']))
+        if ev['kind'] == 1:
+            for c in np.frombuffer(buf, '<u4', n, off):
+                spikes.append(key + (int(c),))
+        else:
+            ts, vs = states.setdefault((key[0], int(ev['layer']), key[1]),
+                                       ([], []))
+            ts.append(key[2])
+            vs.append(np.frombuffer(buf, '<f4', n, off))
+        off += 4 * n
+    spikes = np.array(spikes, dtype=[('source', '<u4'), ('row', '<u4'),
+                                     ('t', '<u4'), ('cell', '<u4')])
+    states = {k: (np.array(t), np.stack(v)) for k, (t, v) in states.items()}
+    return spikes, states
+
+REPLY_DTYPE = np.dtype([('index', '<u4'), ('n_synapses', '<i4'),
+                        ('fit_cost', '<f8')])
+
+class Client:
+    """Scores genomes on a Simulation started with `serve <socket>`.
+
+    c = Client('/tmp/retina.sock')
+    genomes = np.zeros(n, c.genome)  # Or records of an archive or db
+    fit_cost, n_synapses = c.score(genomes)
+    """
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        head = self._read(16)
+        if head[:4] != b'RGEV':
+            raise ValueError('%s is not a Simulation server' % path)
+        version, record_bytes, max_types = struct.unpack('<3I', head[4:])
+        self.genome = genome_dtype(max_types)
+        if self.genome.itemsize != record_bytes:
+            raise ValueError('server genomes are %d bytes' % record_bytes)
+
+    def _read(self, n):
+        buf = bytearray(n)
+        view, got = memoryview(buf), 0
+        while got < n:
+            k = self.sock.recv_into(view[got:])
+            if k == 0:
+                raise ConnectionError('server closed the connection')
+            got += k
+        return bytes(buf)
+
+    def score(self, genomes):
+        """(fit_cost, n_synapses) of each genome; NaN and -1 if invalid."""
+        g = np.ascontiguousarray(genomes, dtype=self.genome)
+        self.sock.sendall(struct.pack('<I', len(g)) + g.tobytes())
+        rep = np.frombuffer(self._read(REPLY_DTYPE.itemsize * len(g)),
+                            REPLY_DTYPE)
+        return rep['fit_cost'], rep['n_synapses']
+
+    def close(self):
+        self.sock.close()
+
+def log2tsv(src, dst):
+    """Write a binary log in the legacy per-row TSV layout."""
+    with open(dst, 'w') as f:
+        for block, model, react, prof in log_blocks(src):
+            for fit_cost, n_synapses, i2e in block:
+                f.write('%g\t%d\t\t%g\n' % (fit_cost, n_synapses, i2e))
+            if model is not None:
+                f.write('#model\t%d\t%g\t%g\n' % model)
+            for bound, error in (react if react is not None else ()):
+                f.write('#react\t%g\t%g\n' % (bound, error))
+            f.write('\n')
+
+if __name__ == '__main__':
+    if len(sys.argv) == 4 and sys.argv[1] == 'log2tsv':
+        log2tsv(sys.argv[2], sys.argv[3])
+    else:
+        print(__doc__)
+        sys.exit(1)
@@ -7,11 +7,10 @@ make release
 DIRNAME=param
 mkdir -p ../$DIRNAME
 
+# Every config of the directory in one sweep, outputs in ../$DIRNAME/<file>
+./Simulation ../$DIRNAME $DIRNAME
+
 for p in $DIRNAME/*;
 do
-  folder=../$DIRNAME/${p##*/}
-  mkdir -p $folder
-  cp $p $folder/param
-  ./Simulation $folder $folder/param
-  ./visualization.py $folder/ 0
+  ./visualization.py ../$DIRNAME/${p##*/}/ 0
 done
@@ -1,13 +1,22 @@
 #include <iostream>
 #include <random>
 #include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <unistd.h>
 #define EIGEN_USE_MKL_ALL
 #include <Eigen/Dense>
 #include "tool.h"
+#include "Profile.h"
+#include "Arena.h"
 #define S1 0
 #define T1 1
 #define S2 2
 #define T2 3
+#define TASK_LABEL 2 // Columns of generate_tasks()' targets past S1 and T1
+#define TASK_CENTRE 3
 
 #define logit(x) (log(x / (1.0 - x)))
 #define sigmoid(x) (1.0 / (1.0 + exp(-x)))
@@ -16,13 +25,48 @@ using Eigen::MatrixXd;
 
 int THREADS, ITERS, POPULATION, ELITES, CELLS, EPOCHS,
     TEST_SIZE, TRAIN_SIZE, T;
+int LOG_FORMAT = 1; // Columnar binary
+int ELITE_FORMAT = 1; // Single archive per run
+double REACT_TOL = 0; // Settling tolerance of adaptive react; 0 is fixed T
+int REACT_K = 1; // Macro-step of the exponential integrator; 1 is Euler
+int EVAL_PARALLEL = 0; // Auto
+int REACT_BATCH = 4; // Genomes per batched react; 0 is one at a time
+int CORES = 0; // Core budget of the run; 0 is every allowed CPU
+int PIN = 1; // Pin GA threads to their cores
+int REACT_CHECK = 0; // Check react against the fixed-T Euler every n genomes
+int SHARED_DATA = 0; // One dataset read by every GA thread
+int STREAM_ROWS = 0; // Rows per chunk of a streamed data_file; 0 loads it
+int REFRESH = 0; // Generations between fresh stimuli; 0 is one dataset
+int MOSAIC = 0; // Cell layout: 0 a 1-D lattice, 1 a 2-D hexagonal grid, 2 jittered
+int PARETO = 0; // Rank on fit_cost, n_synapses and cells instead of total_cost
+int CMAES_EVERY = 0; // Generations between CMA-ES refinements; 0 is none
+int CMAES_ELITES = 1; // Best genomes refined
+int CMAES_ITERS = 5; // CMA-ES iterations per refined genome
+int CMAES_LAMBDA = 0; // Candidates per iteration; 0 is 4 + 3 ln(d)
+int DB_SEED = 0; // Initial genomes taken from the best in DB_FILE
+int NICHE = 0; // Neighbours in fitness sharing; 0 is no niching
+int RECORD_GENOMES = 0; // Final best genomes whose dynamics are recorded
+int RECORD_ROWS = 1; // Test rows they are recorded on
+int RECORD_EVERY = 0; // Steps between recorded layer states; 0 is spikes only
+int SERVE_WAIT = 2; // ms a request waits for others to share its batch
 double TAU, ETA, NOISE, DICISION_BOUNDARY, XRATE;
+double REFRESH_FRAC = 1; // Fraction of rows regenerated at each refresh
+double SURROGATE = 0; // Fraction of children the surrogate sends to eval; 0 is off
+double SURROGATE_EXPLORE = 0.1; // Fraction of children evaluated at random
+double NICHE_RADIUS = 0.1; // Sharing distance, in scaled genome space
 std::string FOLDER;
+std::string DATA_FILE; // Shared dataset to load, or to write on first use
+std::string DB_FILE; // Fitness store read and extended by eval
+std::string SERVE_SOCKET; // Serve evaluations on this socket instead of running the GA
+// Weights of fit_cost, n_synapses and cells in Pareto ranking; 0 drops one
+Eigen::Matrix<double, 3, 1> W_COST(1, 1, 1);
+// Weights of the bounds, label and centre readouts; all 0 is the single nn()
+Eigen::Matrix<double, 3, 1> W_TASKS(0, 0, 0);
 Eigen::IOFormat TSV(4, Eigen::DontAlignCols, "\t", "\n", "", "", "", "");
 // Precision, Alignment, Separators (elements, rows), Pre/Suffix (row, matrix)
 
 std::random_device sd;
-std::mt19937 gen(sd());
+thread_local std::mt19937 gen(sd()); // Of each thread, producers included
 
 double uniform(const double lo, const double hi)
 {
@@ -38,6 +82,21 @@ int uniform(const int lo, const int hi)
     return dis(gen);
 }
 
+double normal(const double mean, const double sd)
+{
+    std::normal_distribution<> dis(mean, sd);
+
+    return dis(gen);
+}
+
+// Fresh seeds for this thread, in a process forked from one that has
+// drawn numbers
+void reseed()
+{
+    gen.seed(sd());
+    std::srand(sd()); // Of MatrixXd::Random
+}
+
 void gaussian_filter(MatrixXd &signals, const MatrixXd &buffer, int n)
 {
     const int r = (int)(CELLS * 0.05) - 1, len = r * 2 + 1;
@@ -70,7 +129,9 @@ void gaussian_filter(MatrixXd &signals, const MatrixXd &buffer, int n)
     }
 }
 
-void generate(MatrixXd &signals, MatrixXd &st, const int n, const int num_sigs)
+// The stimuli of generate() with their rectangles' bounds as targets
+static void rectangles(MatrixXd &signals, MatrixXd &st, const int n,
+                       const int num_sigs)
 {
     st = MatrixXd::Zero(n, num_sigs * 2);
     signals = MatrixXd::Zero(n, CELLS);
@@ -115,6 +176,11 @@ void generate(MatrixXd &signals, MatrixXd &st, const int n, const int num_sigs)
 
         if (uniform(0, 99) < 50) signals.row(i).array() = 1 - signals.row(i).array(); // flip
     }
+}
+
+void generate(MatrixXd &signals, MatrixXd &st, const int n, const int num_sigs)
+{
+    rectangles(signals, st, n, num_sigs);
 
     if (DICISION_BOUNDARY != 0)
     {
@@ -146,116 +212,329 @@ void generate(MatrixXd &signals, MatrixXd &x, const int n)
 	gaussian_filter(signals, buffer, n);
 }
 
+// Stimuli of generate() with the targets of every readout task: the
+// rectangle's bounds, its label against DICISION_BOUNDARY and its centre.
+// The centre stands in for the edge position of generate(signals, x, n),
+// whose step stimuli could not share the simulation.
+void generate_tasks(MatrixXd &signals, MatrixXd &y, const int n)
+{
+    MatrixXd st;
+    rectangles(signals, st, n, 1);
+
+    y.resize(n, 4);
+    y.leftCols(2) = st;
+    y.col(TASK_LABEL) = ((st.col(T1) - st.col(S1)).array()
+                         >= DICISION_BOUNDARY).cast<double>();
+    y.col(TASK_CENTRE) = (st.col(S1) + st.col(T1)) / 2;
+}
+
+bool multitask()
+{
+    return (W_TASKS.array() != 0).any();
+}
+
+// The dataset of a run, with the targets its readouts need
+void generate_data(MatrixXd &signals, MatrixXd &y, const int n)
+{
+    if (multitask()) generate_tasks(signals, y, n);
+    else generate(signals, y, n, 1);
+}
+
 double geq_prob(const MatrixXd &labels)
 {
     return (labels.array() == 1).cast<double>().sum()
             / (labels.cols() * labels.rows());
 }
 
-double nn(const MatrixXd &x, const MatrixXd &y)
+// Rows per block so that a block's working set of row_bytes per row stays
+// in L2, with at least one block per thread
+int block_rows(const long row_bytes, const int rows, const int threads)
+{
+    static const long l2 = (sysconf(_SC_LEVEL2_CACHE_SIZE) > 0)?
+                           sysconf(_SC_LEVEL2_CACHE_SIZE) : (1 << 20);
+
+    int b = std::max(8L, l2 / std::max(1L, row_bytes));
+    return std::max(1, std::min(b, (rows + threads - 1) / threads));
+}
+
+// Per-block partial results of an nn epoch, in the caller's arena
+struct NNBlock
+{
+    double loss;
+    double *dwih, *dwho, *dhh;
+};
+
+/*
+ * Forward pass of rows [b0, b0 + nb) of the epoch's batch of n rows, and
+ * for training epochs the backward pass, as partial sums over the block.
+ * Inputs are x rows x0 + b0..., loss targets are the bottom n rows of y
+ * and training targets the top n rows, as in the full-batch version.
+ */
+void nn_block(const Eigen::Ref<const MatrixXd> &x,
+              const Eigen::Ref<const MatrixXd> &y,
+              const Eigen::Ref<const MatrixXd> &wih,
+              const Eigen::Ref<const MatrixXd> &who, const double hi,
+              const double *hh, const int x0, const int n, const int b0,
+              const int nb, const bool train, const bool bce, NNBlock &res)
+{
+    ArenaScope scope(ARENA);
+    int in_features = wih.rows();
+    int h_features = wih.cols(), out_features = who.cols();
+
+    // Input to hidden; before activation
+    Eigen::Map<MatrixXd> h_ = ARENA.matrix(nb, h_features);
+    h_.noalias() = x.middleRows(x0 + b0, nb) * wih;
+    h_.array() += hi;
+
+    // ReLU
+    Eigen::Map<MatrixXd> relu_mask = ARENA.matrix(nb, h_features);
+    relu_mask.noalias() = (h_.array() >= 0).cast<double>().matrix();
+    // Apply ReLU
+    Eigen::Map<MatrixXd> h = ARENA.matrix(nb, h_features);
+    h.array() = relu_mask.array() * h_.array();
+
+    // Hidden to output; before activation
+    Eigen::Map<MatrixXd> o_ = ARENA.matrix(nb, out_features);
+    o_.noalias() = h * who;
+    for (int i = 0; i < out_features; i++)
+        o_.col(i).array() += hh[i];
+
+    // Sigmoid
+    Eigen::Map<MatrixXd> o = ARENA.matrix(nb, out_features);
+    o.array() = 1 / (1 + exp(-o_.array()));
+
+    Eigen::Map<MatrixXd> res_ = ARENA.matrix(nb, out_features);
+    const auto yl = y.middleRows(y.rows() - n + b0, nb);
+    if (!bce) // MSE; Omega(0.1)
+    {
+        res_.noalias() = o - yl;
+        res.loss = res_.array().pow(2).sum() / n / y.cols();
+    }
+    else // BCE; Omega(0.45)
+    {
+        // A saturated sigmoid would give 0 * log(0)
+        const auto oc = o.array().max(1e-12).min(1 - 1e-12);
+        res_.array() = yl.array() * log(oc);
+        res_.array() += (1 - yl.array()) * log(1 - oc);
+        res.loss = -res_.sum() / n;
+    }
+
+    if (!train) return;
+
+    // dE_do_
+    Eigen::Map<MatrixXd> delta = ARENA.matrix(nb, out_features);
+    delta.noalias() = (o - y.middleRows(b0, nb)) / n;
+    if (!bce)
+        delta.array() *= o.array() * (1 - o.array());
+
+    Eigen::Map<MatrixXd> delta_who_relu = ARENA.matrix(nb, h_features);
+    delta_who_relu.noalias() = delta * who.transpose();
+    delta_who_relu.array() *= relu_mask.array();
+
+    Eigen::Map<MatrixXd>(res.dwih, in_features, h_features).noalias() =
+        x.middleRows(b0, nb).transpose() * delta_who_relu;
+    Eigen::Map<MatrixXd>(res.dwho, h_features, out_features).noalias() =
+        h.transpose() * delta;
+    Eigen::Map<MatrixXd>(res.dhh, 1, out_features) = delta.colwise().sum();
+}
+
+// The batch is split into row blocks run on up to `threads` threads
+double nn(const Eigen::Ref<const MatrixXd> &x,
+          const Eigen::Ref<const MatrixXd> &y, const int threads,
+          const bool bce)
 {
+    ArenaScope scope(ARENA);
     int in_features = x.cols(), out_features = y.cols();
     int h_features = in_features / 4;
 
     // init
-    MatrixXd wih = MatrixXd::Ones(in_features, h_features);
-    MatrixXd who = MatrixXd::Ones(h_features, out_features);
+    Eigen::Map<MatrixXd> wih = ARENA.matrix(in_features, h_features);
+    Eigen::Map<MatrixXd> who = ARENA.matrix(h_features, out_features);
+    wih.setOnes();
+    who.setOnes();
     double hi = 1;// uniform(0.0, 1.0);
     double hh[out_features];
 
     for (int i = 0; i < out_features; i++)
         hh[i] = 1; //uniform(0.0, 1.0);
 
+    long row_bytes = sizeof(double) * (in_features + 3 * h_features
+                                       + 4 * out_features);
+
+    Arena &owner = ARENA;
+    double loss = 0; // Of the epoch; the test loss after the last
     for (int t = 0; t < EPOCHS + 1; t++)
     {
+        PROFILE_SCOPE((t == EPOCHS)? PH_NN_TEST : PH_NN_TRAIN);
         int n = (t == EPOCHS)? TEST_SIZE : TRAIN_SIZE;
+        int x0 = (t == EPOCHS)? x.rows() - n : 0;
+        bool train = t != EPOCHS; // Weights are not used after the test
+
+        int nb = (threads > 1)? block_rows(row_bytes, n, threads) : n;
+        int n_blocks = (n + nb - 1) / nb;
+        ArenaScope epoch(ARENA);
+        std::vector<NNBlock> blocks(n_blocks);
+        for (NNBlock &blk : blocks)
+        {
+            blk.dwih = ARENA.alloc(in_features * h_features);
+            blk.dwho = ARENA.alloc(h_features * out_features);
+            blk.dhh = ARENA.alloc(out_features);
+        }
 
-        // Input to hidden; before activation
-        MatrixXd h_(n, h_features);
-        if (t == EPOCHS)
-            h_.array() = (x.bottomRows(n) * wih).array() + hi;
-        else
-            h_.array() = (x.topRows(n) * wih).array() + hi;
-
-        // ReLU
-        MatrixXd relu_mask(n, h_features);
-        relu_mask.noalias() = (h_.array() >= 0).cast<double>().matrix();
-        // Apply ReLU
-        MatrixXd h(n, h_features);
-        h.array() = relu_mask.array() * h_.array();
-
-        // Hidden to output; before activation
-        MatrixXd o_(n, out_features);
-        o_.noalias() = h * who;
-        for (int i = 0; i < out_features; i++)
-            o_.col(i).array() += hh[i];
+        #pragma omp parallel num_threads(threads) if (threads > 1)
+        {
+            #pragma omp for schedule(static)
+            for (int b = 0; b < n_blocks; b++)
+            {
+                int b0 = b * nb;
+                nn_block(x, y, wih, who, hi, hh, x0, n, b0,
+                         std::min(nb, n - b0), train, bce, blocks[b]);
+            }
+            ARENA.settle(owner);
+        }
 
-        // Sigmoid
-        MatrixXd o(n, out_features);
-        o.array() = 1 / (1 + exp(-o_.array()));
+        // Reduce in block order, so results do not depend on scheduling
+        loss = 0;
+        for (int b = 0; b < n_blocks; b++) loss += blocks[b].loss;
 
+        if (!train) continue;
 
-        // if (t != EPOCHS) // test cycle
-        // if (t == EPOCHS)
-        // {
-            MatrixXd res(n, out_features);
-            if (DICISION_BOUNDARY == 0) // MSE; Omega(0.1)
-            {
-                res.noalias() = o - y.bottomRows(n);
-
-                double loss = res.array().pow(2).sum() / n / y.cols();
-                std::cout << loss << ' '; // test
-                // if (t == EPOCHS)
-                // {
-                    // std::cout << loss << '\n';
-                    // return loss;
-                // }
-            }
-            else // BCE; Omega(0.45)
-            {
-                res.array() = y.bottomRows(n).array() * log(o.array());
-                res.array() += (1 - y.bottomRows(n).array()) * log(1 - o.array());
-                double loss = -res.sum() / n;
-                std::cout << loss << ' '; // test
-                // if (t == EPOCHS)
-                // {
-                    // std::cout << loss << '\n';
-                    // return loss;
-                // }
-            }
-        // }
+        Eigen::Map<MatrixXd> dwih(blocks[0].dwih, in_features, h_features);
+        Eigen::Map<MatrixXd> dwho(blocks[0].dwho, h_features, out_features);
+        for (int b = 1; b < n_blocks; b++)
+        {
+            dwih += Eigen::Map<MatrixXd>(blocks[b].dwih, in_features, h_features);
+            dwho += Eigen::Map<MatrixXd>(blocks[b].dwho, h_features, out_features);
+            for (int i = 0; i < out_features; i++)
+                blocks[0].dhh[i] += blocks[b].dhh[i];
+        }
+
+        wih.noalias() -= ETA * dwih;
 
-        // dE_do_
-        MatrixXd delta(n, out_features);
-        delta.noalias() = (o - y.topRows(n)) / n;
-        if (DICISION_BOUNDARY == 0)
-            delta.array() *= o.array() * (1 - o.array());
+        who.noalias() -= ETA * dwho;
 
+        for (int i = 0; i < out_features; i++)
+            hh[i] -= ETA * blocks[0].dhh[i];
+    }
+    return loss;
+}
+
+/*
+ * nn() over a dataset that is never held whole: every epoch asks `rows`
+ * for its rows `chunk` at a time and sums the chunks' gradients, so that
+ * memory does not grow with the dataset. Rows are numbered as in the
+ * dataset, training rows first and test rows last.
+ */
+double nn_stream(const RowSource &rows, const long n_rows,
+                 const int in_features, const int out_features,
+                 const int chunk)
+{
+    ArenaScope scope(ARENA);
+    int h_features = in_features / 4;
 
-        MatrixXd delta_who_relu(n, h_features);
-        delta_who_relu.noalias() = delta * who.transpose();
-        delta_who_relu = delta_who_relu.array() * relu_mask.array();
+    Eigen::Map<MatrixXd> wih = ARENA.matrix(in_features, h_features);
+    Eigen::Map<MatrixXd> who = ARENA.matrix(h_features, out_features);
+    wih.setOnes();
+    who.setOnes();
+    double hi = 1;
+    double hh[out_features];
 
-        MatrixXd dwih(in_features, h_features);
-        dwih.noalias() = x.topRows(n).transpose() * delta_who_relu;
+    for (int i = 0; i < out_features; i++)
+        hh[i] = 1;
+
+    MatrixXd x, y;
+    double loss = 0; // Of the epoch; the test loss after the last
+    for (int t = 0; t < EPOCHS + 1; t++)
+    {
+        PROFILE_SCOPE((t == EPOCHS)? PH_NN_TEST : PH_NN_TRAIN);
+        long n = (t == EPOCHS)? TEST_SIZE : TRAIN_SIZE;
+        long x0 = (t == EPOCHS)? n_rows - n : 0;
+        bool train = t != EPOCHS;
+
+        ArenaScope epoch(ARENA);
+        NNBlock blk;
+        blk.dwih = ARENA.alloc(in_features * h_features);
+        blk.dwho = ARENA.alloc(h_features * out_features);
+        blk.dhh = ARENA.alloc(out_features);
+        Eigen::Map<MatrixXd> dwih = ARENA.matrix(in_features, h_features);
+        Eigen::Map<MatrixXd> dwho = ARENA.matrix(h_features, out_features);
+        Eigen::Map<MatrixXd> dhh = ARENA.matrix(1, out_features);
+        dwih.setZero();
+        dwho.setZero();
+        dhh.setZero();
+
+        loss = 0;
+        for (long c0 = 0; c0 < n; c0 += chunk)
+        {
+            int nc = std::min((long) chunk, n - c0);
+            rows(x0 + c0, nc, x, y);
+            nn_block(x, y, wih, who, hi, hh, 0, nc, 0, nc, train,
+                     DICISION_BOUNDARY != 0, blk);
+
+            // nn_block averages over the chunk; weight it into the epoch
+            double w = (double) nc / n;
+            loss += w * blk.loss;
+            if (!train) continue;
+
+            dwih += w * Eigen::Map<MatrixXd>(blk.dwih, in_features, h_features);
+            dwho += w * Eigen::Map<MatrixXd>(blk.dwho, h_features, out_features);
+            dhh += w * Eigen::Map<MatrixXd>(blk.dhh, 1, out_features);
+        }
+
+        if (!train) continue;
 
         wih.noalias() -= ETA * dwih;
 
-        who.noalias() -= ETA * h.transpose() * delta;
+        who.noalias() -= ETA * dwho;
 
         for (int i = 0; i < out_features; i++)
-            hh[i] -= ETA * delta.col(i).sum();
+            hh[i] -= ETA * dhh(i);
+    }
+    return loss;
+}
+
+/*
+ * Loss of the readouts of x, a retina's output. A single task trains nn()
+ * on all of y. With W_TASKS set, the one simulation serves every weighted
+ * task instead, each on its columns of generate_tasks()' y: nn() with MSE
+ * on the bounds, nn() with BCE on the label, and decoder() of the centre
+ * over the test rows. A loss that overflowed is infinite, never NaN, so
+ * that rank() can order it.
+ */
+double readout(const Eigen::Ref<const MatrixXd> &x,
+               const Eigen::Ref<const MatrixXd> &y, const int threads)
+{
+    double loss = 0;
+    if (!multitask()) loss = nn(x, y, threads);
+
+    if (W_TASKS(0) != 0)
+        loss += W_TASKS(0) * nn(x, y.leftCols(2), threads, false);
+    if (W_TASKS(1) != 0)
+        loss += W_TASKS(1) * nn(x, y.col(TASK_LABEL), threads, true);
+    if (W_TASKS(2) != 0)
+    {
+        // Output cells tile [0, 1) as the stimulus does
+        int m = x.cols();
+        MatrixXd x0 = (Eigen::VectorXd::LinSpaced(m, 0, m - 1).array()
+                       + 0.5) / m;
+        loss += W_TASKS(2) * decoder(x.bottomRows(TEST_SIZE),
+                                     y.col(TASK_CENTRE).tail(TEST_SIZE), x0);
     }
-    return 0;
+    return std::isfinite(loss)? loss : std::numeric_limits<double>::infinity();
 }
 
-double decoder(const MatrixXd &r, const MatrixXd &x, const MatrixXd &x0)
+// Squared error of the rate-weighted mean of x0 against x. A row where no
+// cell fired decodes nothing, and costs 1, the most a position in [0, 1]
+// can be off by.
+double decoder(const Eigen::Ref<const MatrixXd> &r,
+               const Eigen::Ref<const MatrixXd> &x,
+               const Eigen::Ref<const MatrixXd> &x0)
 {
     MatrixXd denominator(r.rows(), 1);
     denominator.noalias() = r.rowwise().sum();
     MatrixXd out(r.rows(), 1);
     out.noalias() = r * x0;
-    out = out.array() / denominator.array();
-    out = out - x;
-    return out.array().pow(2).sum() / r.rows();
+    out = (denominator.array() > 0).select(
+        (out.array() / denominator.array() - x.array()).square(), 1.0);
+    return out.sum() / r.rows();
 }
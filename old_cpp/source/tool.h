@@ -1,24 +1,51 @@
 #ifndef TOOL_H
 #define TOOL_H
 
+#include <functional>
 #define EIGEN_USE_MKL_ALL
 #include <Eigen/Dense>
 using Eigen::MatrixXd;
 
+// Readout inputs x and targets y of dataset rows [r0, r0 + n)
+typedef std::function<void(const long r0, const int n, MatrixXd &x,
+                           MatrixXd &y)> RowSource;
+
 extern int THREADS, ITERS, POPULATION, ELITES, CELLS, RGCS, EPOCHS,
            TEST_SIZE, TRAIN_SIZE, T;
-extern double TAU, ETA, NOISE, DICISION_BOUNDARY, XRATE;
+extern int LOG_FORMAT, ELITE_FORMAT, REACT_CHECK, REACT_K, EVAL_PARALLEL,
+           REACT_BATCH, CORES, PIN, SHARED_DATA, STREAM_ROWS, REFRESH,
+           MOSAIC, PARETO, CMAES_EVERY, CMAES_ELITES, CMAES_ITERS,
+           CMAES_LAMBDA, DB_SEED, NICHE, RECORD_GENOMES, RECORD_ROWS,
+           RECORD_EVERY, SERVE_WAIT;
+extern double TAU, ETA, NOISE, DICISION_BOUNDARY, XRATE, REACT_TOL,
+              REFRESH_FRAC, SURROGATE, SURROGATE_EXPLORE, NICHE_RADIUS;
 extern bool INTERNAL_CONN;
-extern std::string FOLDER;
-extern Eigen::Matrix<double, 3, 1> W_COST;
+extern std::string FOLDER, DATA_FILE, DB_FILE, SERVE_SOCKET;
+extern Eigen::Matrix<double, 3, 1> W_COST, W_TASKS;
 extern Eigen::IOFormat TSV;
 
 double uniform(const double lo, const double hi);
 int uniform(const int lo, const int hi);
+double normal(const double mean, const double sd);
+void reseed();
+void gaussian_filter(MatrixXd &signals, const MatrixXd &buffer, int n);
 void generate(MatrixXd &signals, MatrixXd &st, const int n, const int num_sigs);
 void generate(MatrixXd &signals, MatrixXd &x, const int n);
+void generate_tasks(MatrixXd &signals, MatrixXd &y, const int n);
+bool multitask();
+void generate_data(MatrixXd &signals, MatrixXd &y, const int n);
 double geq_prob(const MatrixXd &labels);
-double nn(const MatrixXd &x, const MatrixXd &y);
-double decoder(const MatrixXd &r, const MatrixXd &x, const MatrixXd &x0);
+double nn(const Eigen::Ref<const MatrixXd> &x,
+          const Eigen::Ref<const MatrixXd> &y, const int threads = 1,
+          const bool bce = DICISION_BOUNDARY != 0);
+double nn_stream(const RowSource &rows, const long n_rows,
+                 const int in_features, const int out_features,
+                 const int chunk);
+int block_rows(const long row_bytes, const int rows, const int threads);
+double readout(const Eigen::Ref<const MatrixXd> &x,
+               const Eigen::Ref<const MatrixXd> &y, const int threads = 1);
+double decoder(const Eigen::Ref<const MatrixXd> &r,
+               const Eigen::Ref<const MatrixXd> &x,
+               const Eigen::Ref<const MatrixXd> &x0);
 
 #endif
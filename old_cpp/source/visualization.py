@@ -7,6 +7,7 @@ import matplotlib
 matplotlib.use('Agg')
 import matplotlib.pyplot as plt
 import networkx as nx
+import retina_io
 
 plt.rcParams['axes.spines.right'] = False
 plt.rcParams['axes.spines.top'] = False
@@ -150,8 +151,8 @@ if __name__ == '__main__':
 
     for i in range(max_id + 1):
         # load
-        log = np.loadtxt(os.path.join(path, 'log%d.tsv' % i),
-                         dtype=np.float64)
+        log = retina_io.read_log(retina_io.find_log(path, i))
+        log = log.reshape(-1, log.shape[-1])
         logs.append(log[:, [0, 1, 2]])
         print(log.shape)
 